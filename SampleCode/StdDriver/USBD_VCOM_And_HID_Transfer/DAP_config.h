@@ -10,10 +10,24 @@
 
 #define DAP_SWD                 1               ///< SWD Mode:  1 = available, 0 = not available
 
-#define DAP_JTAG                0               ///< JTAG Mode: 0 = not available
+#define DAP_JTAG                1               ///< JTAG Mode: 1 = available, 0 = not available
+
+#define DAP_JTAG_SPI            1               ///< JTAG shifts through SPI0: 1 = available, 0 = GPIO only
 
 #define DAP_JTAG_DEV_CNT        8               ///< Maximum number of JTAG devices on scan chain
 
+#define APROM_CODE_SIZE         0x00018000U     ///< APROM bytes reserved for the firmware, must match the IROM1 size of the project
+
+#define DAP_JTAG_CACHE_ADDR     0x0001FE00U     ///< APROM page caching discovered scan chains (0 = no cache)
+
+#define STANDALONE_ADDR         0x00018000U     ///< APROM area holding the standalone programming image (0 = no standalone programming)
+
+#define STANDALONE_SIZE         0x00007E00U     ///< Size of the standalone area in bytes (whole flash pages)
+
+#define XSVF_MAX_BITS           1024U           ///< Maximum XSVF shift length in bits (0 = no XSVF player)
+
+#define DAP_SHADOW              1               ///< Skip DAP_Transfer writes repeating DP SELECT, MEM-AP CSW or TAR: 1 = enabled, 0 = disabled
+
 #define DAP_DEFAULT_PORT        1               ///< Default JTAG/SWJ Port Mode: 1 = SWD, 2 = JTAG.
 
 #define DAP_DEFAULT_SWJ_CLOCK   4000000         ///< Default SWD/JTAG clock frequency in Hz.
@@ -27,19 +41,27 @@
 
 
 /// Indicate that UART Serial Wire Output (SWO) trace is available.
-#define SWO_UART                0               ///< SWO UART:  1 = available, 0 = not available
+#define SWO_UART                1               ///< SWO UART:  1 = available, 0 = not available
+
+#define SWO_UART_MAX_BAUDRATE   3000000U        ///< SWO UART Maximum Baudrate in Hz
 
-#define SWO_UART_MAX_BAUDRATE   115200U       ///< SWO UART Maximum Baudrate in Hz
+#define SWO_UART_AUTOBAUD       1               ///< SWO UART Baudrate 0 = auto detect: 1 = available, 0 = not available
 
 /// Indicate that Manchester Serial Wire Output (SWO) trace is available.
-#define SWO_MANCHESTER          0               ///< SWO Manchester:  1 = available, 0 = not available
+#define SWO_MANCHESTER          1               ///< SWO Manchester:  1 = available, 0 = not available
+
+#define SWO_MANCHESTER_MAX_BAUDRATE 1000000U    ///< SWO Manchester Maximum Baudrate in Hz
 
 #define SWO_BUFFER_SIZE         4096U           ///< SWO Trace Buffer Size in bytes (must be 2^n)
 
-#define SWO_STREAM              0               ///< SWO Streaming Trace: 1 = available, 0 = not available.
+#define SWO_STREAM              1               ///< SWO Streaming Trace: 1 = available, 0 = not available.
+
+#define SAMPLE_BUFFER_SIZE      1024U           ///< Memory sampler record buffer in bytes (must be 2^n, 0 = no sampler, needs SWO_STREAM)
+
+#define PROFILE_BUCKETS         256U            ///< PC sampling profiler histogram buckets (0 = no profiler)
 
 /// Clock frequency of the Test Domain Timer. Timer value is returned with \ref TIMESTAMP_GET.
-#define TIMESTAMP_CLOCK         1000000U      ///< Timestamp clock in Hz (0 = timestamps not supported).
+#define TIMESTAMP_CLOCK         48000000U     ///< Timestamp clock in Hz (0 = timestamps not supported).
 
 /// Debug Unit is connected to fixed Target Device.
 #define TARGET_DEVICE_FIXED     0               ///< Target Device: 1 = known, 0 = unknown;
@@ -81,6 +103,36 @@ DAP Hardware I/O Pin Access Functions
 
 #define SWD_RST				PA0
 
+// JTAG uses its own pins: TCK/TDI/TDO on PD can be switched to SPI0_CLK/MOSI/MISO,
+// TMS and nTRST are GPIO on PB. PB12/PB13 stay with UART0 for the VCOM bridge.
+#define JTAG_SPI_PORT		PD
+#define JTAG_TDI_PIN		0
+#define JTAG_TDO_PIN		1
+#define JTAG_TCK_PIN		2
+
+#define JTAG_PORT			PB
+#define JTAG_TMS_PIN		15
+#define JTAG_nTRST_PIN		11
+
+#define JTAG_TDI			PD0
+#define JTAG_TDO			PD1
+#define JTAG_TCK			PD2
+#define JTAG_TMS			PB15
+#define JTAG_nTRST			PB11
+
+#define JTAG_SPI_MFP_REG	(SYS->GPD_MFPL)
+#define JTAG_SPI_MFP_Msk	(SYS_GPD_MFPL_PD0MFP_Msk | SYS_GPD_MFPL_PD1MFP_Msk | SYS_GPD_MFPL_PD2MFP_Msk)
+#define JTAG_SPI_MFP		(SYS_GPD_MFPL_PD0MFP_SPI0_MOSI | SYS_GPD_MFPL_PD1MFP_SPI0_MISO | SYS_GPD_MFPL_PD2MFP_SPI0_CLK)
+#define JTAG_GPIO_MFP_Msk	(SYS_GPB_MFPH_PB11MFP_Msk | SYS_GPB_MFPH_PB15MFP_Msk)
+
+// Standalone programming: start button (active low) and result LED (active high)
+#define STANDALONE_PORT			PB
+#define STANDALONE_BUTTON_PIN	0
+#define STANDALONE_LED_PIN		1
+
+#define STANDALONE_BUTTON		PB0
+#define STANDALONE_LED			PB1
+
 
 /** Setup JTAG I/O pins: TCK, TMS, TDI, TDO, nTRST, and nRESET.
  - TCK, TMS, TDI, nTRST, nRESET to output mode and set to high level.
@@ -89,11 +141,22 @@ DAP Hardware I/O Pin Access Functions
 static void PORT_JTAG_SETUP(void)
 {
 #if (DAP_JTAG != 0)
+	JTAG_SPI_MFP_REG &= ~JTAG_SPI_MFP_Msk;
+	SYS->GPB_MFPH &= ~JTAG_GPIO_MFP_Msk;
+
+	GPIO_SetMode(JTAG_SPI_PORT, (1 << JTAG_TCK_PIN) | (1 << JTAG_TDI_PIN), GPIO_MODE_OUTPUT);
+	GPIO_SetMode(JTAG_PORT, (1 << JTAG_TMS_PIN), GPIO_MODE_OUTPUT);
+	JTAG_TCK = 1; JTAG_TMS = 1; JTAG_TDI = 1;
+	GPIO_SetMode(JTAG_SPI_PORT, (1 << JTAG_TDO_PIN), GPIO_MODE_INPUT);
+	GPIO_SetMode(JTAG_PORT, (1 << JTAG_nTRST_PIN), GPIO_MODE_OPEN_DRAIN); JTAG_nTRST = 1;
+
+	GPIO_SetMode(SWD_RST_PORT, (1 << SWD_RST_PIN), GPIO_MODE_OUTPUT); SWD_RST = 1;
 #endif
 }
 
 /** Setup SWD I/O pins: SWCLK, SWDIO, and nRESET.
  - SWCLK, SWDIO, nRESET to output mode and set to default high level.
+ - JTAG TCK, TMS, TDI to High-Z mode.
 */
 static void PORT_SWD_SETUP(void)
 {
@@ -101,9 +164,21 @@ static void PORT_SWD_SETUP(void)
 	GPIO_SetMode(SWDIO_PORT, (1 << SWDIO_PIN), GPIO_MODE_OUTPUT); SWD_SWDIO = 1;
 	
 	GPIO_SetMode(SWD_RST_PORT, (1 << SWD_RST_PIN), GPIO_MODE_OUTPUT); SWD_RST = 1;
-	
+
+#if (DAP_JTAG != 0)
+	GPIO_SetMode(JTAG_SPI_PORT, (1 << JTAG_TCK_PIN) | (1 << JTAG_TDI_PIN), GPIO_MODE_INPUT);
+	GPIO_SetMode(JTAG_PORT, (1 << JTAG_TMS_PIN), GPIO_MODE_INPUT);
+#endif
 }
 
+#if (DAP_JTAG != 0)
+// JTAG port active: only PORT_JTAG_SETUP drives TCK
+static __inline uint32_t PORT_JTAG_ACTIVE(void)
+{
+	return (((JTAG_SPI_PORT->MODE >> (JTAG_TCK_PIN << 1)) & 3U) == GPIO_MODE_OUTPUT) ? 1U : 0U;
+}
+#endif
+
 /** Disable JTAG/SWD I/O Pins.
  - TCK/SWCLK, TMS/SWDIO, TDI, TDO, nTRST, nRESET to High-Z mode.
 */
@@ -113,6 +188,12 @@ static void PORT_OFF(void)
 	GPIO_SetMode(SWDIO_PORT, (1 << SWDIO_PIN), GPIO_MODE_INPUT);
 	
 	GPIO_SetMode(SWD_RST_PORT, (1 << SWD_RST_PIN), GPIO_MODE_INPUT);
+
+#if (DAP_JTAG != 0)
+	JTAG_SPI_MFP_REG &= ~JTAG_SPI_MFP_Msk;
+	GPIO_SetMode(JTAG_SPI_PORT, (1 << JTAG_TCK_PIN) | (1 << JTAG_TDI_PIN) | (1 << JTAG_TDO_PIN), GPIO_MODE_INPUT);
+	GPIO_SetMode(JTAG_PORT, (1 << JTAG_TMS_PIN) | (1 << JTAG_nTRST_PIN), GPIO_MODE_INPUT);
+#endif
 }
 
 
@@ -121,18 +202,50 @@ static void PORT_OFF(void)
 // Current status of the SWCLK/TCK DAP hardware I/O pin
 static __inline uint32_t PIN_SWCLK_TCK_IN(void)
 {
-     //return (SWD_GPIO->PMD & (3 << (PIN_SWCLK << 1))) ? 1 : 0;
+#if (DAP_JTAG != 0)
+	if (PORT_JTAG_ACTIVE()) {
+		return JTAG_TCK;
+	}
+#endif
 	return  SWD_SWCLK;
 }
 
 static __inline void PIN_SWCLK_TCK_SET(void)
 {
 	SWD_SWCLK = 1;
+#if (DAP_JTAG != 0)
+	JTAG_TCK = 1;
+#endif
 }
 
 static __inline void PIN_SWCLK_TCK_CLR(void)
 {
         SWD_SWCLK = 0;
+#if (DAP_JTAG != 0)
+	JTAG_TCK = 0;
+#endif
+}
+
+// SWCLK only (SWD protocol engine)
+static __inline void PIN_SWCLK_SWD_SET(void)
+{
+	SWD_SWCLK = 1;
+}
+
+static __inline void PIN_SWCLK_SWD_CLR(void)
+{
+	SWD_SWCLK = 0;
+}
+
+// TCK only (JTAG protocol engine)
+static __inline void PIN_TCK_JTAG_SET(void)
+{
+	JTAG_TCK = 1;
+}
+
+static __inline void PIN_TCK_JTAG_CLR(void)
+{
+	JTAG_TCK = 0;
 }
 
 
@@ -141,17 +254,39 @@ static __inline void PIN_SWCLK_TCK_CLR(void)
 // Current status of the SWDIO/TMS DAP hardware I/O pin
 static __inline uint32_t PIN_SWDIO_TMS_IN(void)
 {
+#if (DAP_JTAG != 0)
+	if (PORT_JTAG_ACTIVE()) {
+		return JTAG_TMS;
+	}
+#endif
     return SWD_SWDIO;
 }
 
 static __inline void PIN_SWDIO_TMS_SET(void)
 {
      SWD_SWDIO = 1;
+#if (DAP_JTAG != 0)
+	JTAG_TMS = 1;
+#endif
 }
 
 static __inline void PIN_SWDIO_TMS_CLR(void)
 {
     SWD_SWDIO = 0;
+#if (DAP_JTAG != 0)
+	JTAG_TMS = 0;
+#endif
+}
+
+// TMS only (JTAG protocol engine)
+static __inline void PIN_TMS_JTAG_SET(void)
+{
+	JTAG_TMS = 1;
+}
+
+static __inline void PIN_TMS_JTAG_CLR(void)
+{
+	JTAG_TMS = 0;
 }
 
 
@@ -181,13 +316,16 @@ static __inline void PIN_SWDIO_OUT_DISABLE(void)
 static __inline uint32_t PIN_TDI_IN(void)
 {
 #if (DAP_JTAG != 0)
-#endif
+	return JTAG_TDI;
+#else
 	return 0;
+#endif
 }
 
 static __inline void PIN_TDI_OUT(uint32_t bit)
 {
 #if (DAP_JTAG != 0)
+	JTAG_TDI = bit & 1;
 #endif
 }
 
@@ -197,8 +335,10 @@ static __inline void PIN_TDI_OUT(uint32_t bit)
 static __inline uint32_t PIN_TDO_IN(void)
 {
 #if (DAP_JTAG != 0)
-#endif
+	return JTAG_TDO;
+#else
 	return 0;
+#endif
 }
 
 
@@ -206,13 +346,58 @@ static __inline uint32_t PIN_TDO_IN(void)
 
 static __inline uint32_t PIN_nTRST_IN(void)
 {
+#if (DAP_JTAG != 0)
+	return JTAG_nTRST;
+#else
     return 0;
+#endif
 }
 
 static __inline void PIN_nTRST_OUT(uint32_t bit)
 {
+#if (DAP_JTAG != 0)
+	JTAG_nTRST = bit & 1;
+#endif
+}
+
+
+// JTAG SPI shifter ----------------------------------------
+#if ((DAP_JTAG != 0) && (DAP_JTAG_SPI != 0))
+
+/** Configure SPI0 for JTAG shifting: master, mode 3 (TCK idles high, TDI changes
+on falling and TDO is sampled on rising edge), LSB first.
+\param clock requested TCK frequency in Hz
+\return actual TCK frequency in Hz
+*/
+static __inline uint32_t PORT_JTAG_SPI_CLOCK(uint32_t clock)
+{
+	uint32_t actual;
+
+	actual = SPI_Open(SPI0, SPI_MASTER, SPI_MODE_3, 8, clock);
+	SPI_SET_LSB_FIRST(SPI0);
+	return actual;
 }
 
+/** Shift TDI/TDO bits through SPI0 while TMS is held by GPIO. TCK ends high.
+\param tdi TDI bits, first bit in bit 0
+\param n   number of bits (8..32)
+\return TDO bits, first bit in bit 0
+*/
+static __inline uint32_t PIN_JTAG_SPI_SHIFT(uint32_t tdi, uint32_t n)
+{
+	uint32_t tdo;
+
+	SPI0->CTL = (SPI0->CTL & ~SPI_CTL_DWIDTH_Msk) | ((n & 0x1FU) << SPI_CTL_DWIDTH_Pos);
+	JTAG_SPI_MFP_REG = (JTAG_SPI_MFP_REG & ~JTAG_SPI_MFP_Msk) | JTAG_SPI_MFP;
+	SPI0->TX = tdi;
+	while (SPI0->STATUS & SPI_STATUS_BUSY_Msk);
+	tdo = SPI0->RX;
+	JTAG_SPI_MFP_REG &= ~JTAG_SPI_MFP_Msk;
+	return tdo;
+}
+
+#endif
+
 // nRESET Pin I/O------------------------------------------
 static __inline uint32_t PIN_nRESET_IN(void)
 {
@@ -245,9 +430,30 @@ static __inline void LED_RUNNING_OUT(uint32_t bit)
 }
 
 
+/** Get timestamp of Test Domain Timer.
+TIMER0 runs continuously at TIMESTAMP_CLOCK (HIRC); its 24-bit counter is extended
+to 32 bits by counting compare matches at 0xFFFFFF in TMR0_IRQHandler. A match that
+is still pending (caller in an interrupt or with interrupts disabled) is accounted
+for when the counter has already wrapped.
+\return Current timestamp value.
+*/
+#define TIMESTAMP_TIMER         TIMER0
+
+extern volatile uint32_t g_u32TimestampWrap;
+
 __STATIC_INLINE uint32_t TIMESTAMP_GET (void) {
-	//return (DWT->CYCCNT) / (CPU_CLOCK / TIMESTAMP_CLOCK);
-	return 0;
+	uint32_t wrap, cnt, pend;
+
+	do {
+		wrap = g_u32TimestampWrap;
+		cnt  = TIMESTAMP_TIMER->CNT;
+		pend = TIMESTAMP_TIMER->INTSTS & TIMER_INTSTS_TIF_Msk;
+	} while (wrap != g_u32TimestampWrap);
+
+	if (pend && (cnt < 0x800000U)) {
+		wrap++;
+	}
+	return ((wrap << 24) | cnt);
 }
 
 static void DAP_SETUP(void)
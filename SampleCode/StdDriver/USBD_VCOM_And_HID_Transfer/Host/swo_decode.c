@@ -0,0 +1,190 @@
+/******************************************************************************
+ * @file     swo_decode.c
+ * @brief    Host reference decoder for the compressed SWO trace stream.
+ *
+ *           Build:  cc -O2 -o swo_decode swo_decode.c
+ *           Usage:  swo_decode < compressed.bin > itm.bin
+ *
+ * @note
+ *           Compression is enabled with flag bit4 of the SWO_Filter vendor
+ *           command (0x80) and applies to packets forwarded by the probe
+ *           packet filter. The stream is a regular ITM/DWT packet stream in
+ *           which two headers reserved by the ITM protocol carry compressed
+ *           packets:
+ *
+ *           0x04 <varint>  PC sample delta. The varint is the zigzag encoded
+ *                          signed half-word delta to the previous PC sample:
+ *                            d  = (v & 1) ? -(v >> 1) - 1 : (v >> 1)
+ *                            pc = previous_pc + 2 * d
+ *                          It expands to the DWT periodic PC sample packet
+ *                          0x17 <pc LSB first, 4 bytes>.
+ *           0x14 <varint>  Previous packet repeated <varint> more times.
+ *
+ *           A varint holds 7 bits per byte, LSB group first; bit7 set means
+ *           that more bytes follow.
+ *
+ *           The previous packet is the last expanded packet other than
+ *           synchronization (0x00 .. 0x00 0x80) and overflow (0x70) which
+ *           pass through unchanged. The previous PC sample is the last
+ *           expanded 0x17 packet. The probe sends an uncompressed packet
+ *           whenever a reference is unknown (start of capture, trace buffer
+ *           overrun), so no decoder state has to be carried across captures.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+
+#define PC_DELTA    0x04U
+#define REPEAT      0x14U
+#define PC_SAMPLE   0x17U
+
+static uint8_t  last[7];        /* Previous packet */
+static uint32_t last_len;       /* Previous packet size (0: none) */
+static uint32_t last_pc;        /* Previous PC sample */
+
+/* Read varint from input, return -1 on end of input */
+static int read_varint(FILE *in, uint32_t *value)
+{
+    uint32_t v = 0U;
+    uint32_t shift = 0U;
+    int c;
+
+    do {
+        if ((c = getc(in)) == EOF)
+            return -1;
+
+        v |= (uint32_t)(c & 0x7F) << shift;
+        shift += 7U;
+    } while ((c & 0x80) && (shift < 32U));
+
+    *value = v;
+    return 0;
+}
+
+/* Return packet size for a header, 0 if it is terminated by continuation bit */
+static uint32_t packet_size(uint32_t hdr, uint32_t *max)
+{
+    *max = 5U;
+
+    if ((hdr & 0x03U) != 0U)
+        return 1U + (1U << ((hdr & 0x03U) - 1U));      /* Source packet */
+
+    if ((hdr & 0x0FU) == 0x00U)
+        return (hdr & 0x80U) ? 0U : 1U;                 /* Local timestamp */
+
+    if ((hdr == 0x94U) || (hdr == 0xB4U)) {
+        *max = (hdr == 0xB4U) ? 7U : 5U;                /* Global timestamp */
+        return 0U;
+    }
+
+    if ((hdr & 0x0BU) == 0x08U)
+        return (hdr & 0x80U) ? 0U : 1U;                 /* Extension */
+
+    return 1U;                                          /* Reserved */
+}
+
+static void put_packet(const uint8_t *buf, uint32_t len, FILE *out)
+{
+    fwrite(buf, 1U, len, out);
+}
+
+int main(void)
+{
+    FILE *in = stdin;
+    FILE *out = stdout;
+    uint8_t buf[7];
+    uint32_t zeros = 0U;
+    uint32_t size, max, len, value, i;
+    int32_t delta;
+    int c;
+
+    while ((c = getc(in)) != EOF) {
+        if (c == 0x00) {
+            zeros++;
+            putc(c, out);
+            continue;
+        }
+
+        if ((c == 0x80) && zeros) {
+            zeros = 0U;
+            putc(c, out);
+            continue;
+        }
+
+        zeros = 0U;
+
+        if (c == 0x70) {
+            putc(c, out);
+            continue;
+        }
+
+        if (c == PC_DELTA) {
+            if (read_varint(in, &value) < 0)
+                break;
+
+            delta = (value & 1U) ? -(int32_t)(value >> 1) - 1 : (int32_t)(value >> 1);
+            last_pc += (uint32_t)delta * 2U;
+            last[0] = PC_SAMPLE;
+            last[1] = (uint8_t)(last_pc >>  0);
+            last[2] = (uint8_t)(last_pc >>  8);
+            last[3] = (uint8_t)(last_pc >> 16);
+            last[4] = (uint8_t)(last_pc >> 24);
+            last_len = 5U;
+            put_packet(last, last_len, out);
+            continue;
+        }
+
+        if (c == REPEAT) {
+            if (read_varint(in, &value) < 0)
+                break;
+
+            if (last_len == 0U) {
+                fprintf(stderr, "swo_decode: repeat without previous packet\n");
+                continue;
+            }
+
+            for (i = 0U; i < value; i++)
+                put_packet(last, last_len, out);
+
+            continue;
+        }
+
+        /* Uncompressed packet */
+        buf[0] = (uint8_t)c;
+        len = 1U;
+        size = packet_size((uint32_t)c, &max);
+
+        if (size == 0U) {
+            do {
+                if ((c = getc(in)) == EOF)
+                    break;
+
+                buf[len++] = (uint8_t)c;
+            } while ((c & 0x80) && (len < max));
+        } else {
+            while (len < size) {
+                if ((c = getc(in)) == EOF)
+                    break;
+
+                buf[len++] = (uint8_t)c;
+            }
+        }
+
+        if (c == EOF)
+            break;
+
+        if ((buf[0] == PC_SAMPLE) && (len == 5U)) {
+            last_pc = (uint32_t)buf[1] | ((uint32_t)buf[2] << 8) |
+                      ((uint32_t)buf[3] << 16) | ((uint32_t)buf[4] << 24);
+        }
+
+        for (i = 0U; i < len; i++)
+            last[i] = buf[i];
+
+        last_len = len;
+        put_packet(buf, len, out);
+    }
+
+    return 0;
+}
@@ -165,6 +165,8 @@ void USBD_IRQHandler(void)
         {
             /* Clear event flag */
             USBD_CLR_INT_FLAG(USBD_INTSTS_EP7);
+            /* Bulk IN (SWO stream) */
+            EP7_Handler();
         }
     }
 }
@@ -253,6 +255,12 @@ void HID_Init(void)
     /* trigger to receive OUT data */
     USBD_SET_PAYLOAD_LEN(EP6, EP6_MAX_PKT_SIZE);
 USBD_SET_PAYLOAD_LEN(EP5, EP5_MAX_PKT_SIZE);
+
+    /*****************************************************/
+    /* EP7 ==> Bulk IN endpoint, address 6 (SWO stream) */
+    USBD_CONFIG_EP(EP7, USBD_CFG_EPMODE_IN | SWO_IN_EP_NUM);
+    /* Buffer range for EP7 */
+    USBD_SET_EP_BUF_ADDR(EP7, EP7_BUF_BASE);
 }
 
 void HID_ClassRequest(void)
@@ -451,6 +459,8 @@ void VCOM_LineCoding(uint8_t port)
 /***************************************************************/
 #include "DAP_Config.h"
 #include "DAP.h"
+#include "SWD_host.h"
+#include "SWD_sample.h"
 static volatile uint8_t  USB_RequestFlag;       // Request  Buffer Usage Flag
 static volatile uint32_t USB_RequestIn;         // Request  Buffer In  Index
 static volatile uint32_t USB_RequestOut;        // Request  Buffer Out Index
@@ -469,7 +479,12 @@ uint8_t usbd_hid_process(void)
 	// Process pending requests
 	if((USB_RequestOut != USB_RequestIn) || USB_RequestFlag)
 	{
-		DAP_ProcessCommand(USB_Request[USB_RequestOut], USB_Response[USB_ResponseIn]);
+		// Give the AP state back to the host, a long-poll does not touch the target
+		if(USB_Request[USB_RequestOut][0] != ID_DAP_HaltEvent)
+			swd_background_end();
+
+		if((DAP_ProcessCommand(USB_Request[USB_RequestOut], USB_Response[USB_ResponseIn]) & 0xFFFF) == 0)
+			return 0;	// Long-poll pending, run the request again on the next call
 
 		// Update request index and flag
 		n = USB_RequestOut + 1;
@@ -544,5 +559,89 @@ void HID_SetInReport(void)
 }
 
 
+/***************************************************************/
+/* SWO streaming trace (bulk IN EP7)                           */
+#if (SWO_STREAM != 0)
+static uint8_t * volatile SWO_TxBuf;             // Stream data pointer
+static volatile uint32_t  SWO_TxNum;             // Stream bytes left to send
+static volatile uint8_t   SWO_TxBusy = 0;        // Stream transfer active
+static volatile uint8_t   SWO_TxSample = 0;      // Transfer carries memory samples
+
+static void SWO_SendPacket(void)
+{
+	uint32_t n;
+
+	n = SWO_TxNum;
+	if(n > EP7_MAX_PKT_SIZE)
+		n = EP7_MAX_PKT_SIZE;
+
+	USBD_MemCopy((uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP7)), SWO_TxBuf, n);
+	USBD_SET_PAYLOAD_LEN(EP7, n);
 
+	SWO_TxBuf += n;
+	SWO_TxNum -= n;
+}
+
+// Start streaming num bytes of trace data, SWO_TransferComplete is called when done
+void SWO_QueueTransfer(uint8_t *buf, uint32_t num)
+{
+#if (SAMPLE_BUFFER_SIZE != 0U)
+	if(SWO_TxBusy && SWO_TxSample)
+		SWD_Sample_Abort();	// Trace has priority on the stream
+#endif
+	SWO_TxSample = 0;
+	SWO_TxBuf  = buf;
+	SWO_TxNum  = num;
+	SWO_TxBusy = 1;
+	SWO_SendPacket();
+}
+
+// Start streaming num bytes of memory samples, SWD_Sample_TransferComplete is called when done
+//   return: 0 = stream endpoint busy, 1 = transfer started
+uint8_t Sample_QueueTransfer(uint8_t *buf, uint32_t num)
+{
+	if(SWO_TxBusy)
+		return 0;
+
+	SWO_TxSample = 1;
+	SWO_TxBuf  = buf;
+	SWO_TxNum  = num;
+	SWO_TxBusy = 1;
+	SWO_SendPacket();
+	return 1;
+}
 
+// Abort the pending stream transfer
+void SWO_AbortTransfer(void)
+{
+	SWO_TxBusy = 0;
+	SWO_TxNum  = 0;
+	USBD_STOP_TRANSACTION(EP7);
+}
+
+#endif
+
+void EP7_Handler(void)  /* Bulk IN handler (SWO stream, memory samples) */
+{
+#if (SWO_STREAM != 0)
+	if(SWO_TxBusy == 0)
+		return;
+
+	if(SWO_TxNum)
+	{
+		SWO_SendPacket();
+	}
+	else
+	{
+		SWO_TxBusy = 0;
+#if (SAMPLE_BUFFER_SIZE != 0U)
+		if(SWO_TxSample)
+		{
+			SWD_Sample_TransferComplete();
+			return;
+		}
+#endif
+		SWO_TransferComplete();
+	}
+#endif
+}
@@ -49,6 +49,7 @@
 #define EP4_MAX_PKT_SIZE    8
 #define EP5_MAX_PKT_SIZE    64
 #define EP6_MAX_PKT_SIZE    64
+#define EP7_MAX_PKT_SIZE    64
 
 #define SETUP_BUF_BASE  0
 #define SETUP_BUF_LEN   8
@@ -66,6 +67,8 @@
 #define EP5_BUF_LEN     EP5_MAX_PKT_SIZE
 #define EP6_BUF_BASE    (EP5_BUF_BASE + EP5_BUF_LEN)
 #define EP6_BUF_LEN     EP6_MAX_PKT_SIZE
+#define EP7_BUF_BASE    (EP6_BUF_BASE + EP6_BUF_LEN)
+#define EP7_BUF_LEN     EP7_MAX_PKT_SIZE
 
 /* Define the EP number */
 #define BULK_IN_EP_NUM        0x01
@@ -73,6 +76,7 @@
 #define INT_IN_EP_NUM         0x03
 #define INT_IN_EP_NUM_1       0x04
 #define INT_OUT_EP_NUM_1      0x05
+#define SWO_IN_EP_NUM         0x06
 
 /* Define Descriptor information */
 #define HID_DEFAULT_INT_IN_INTERVAL     1
@@ -126,6 +130,8 @@ void EP6_Handler(void);
 void HID_SetInReport(void);
 void HID_GetOutReport(uint8_t *pu8EpBuf, uint32_t u32Size);
 
+void EP7_Handler(void);
+
 #endif  /* __USBD_HID_H_ */
 
 /*** (C) COPYRIGHT 2018 Nuvoton Technology Corp. ***/
@@ -36,6 +36,9 @@
 //#include "info.h"
 //#include "dap_strings.h"
 
+#ifndef __WEAK
+#define __WEAK __attribute__((weak))
+#endif
 
 #if (DAP_PACKET_SIZE < 64U)
 #error "Minimum Packet Size is 64!"
@@ -63,6 +66,19 @@
          DAP_Data_t DAP_Data;           // DAP Data
 volatile uint8_t    DAP_TransferAbort;  // Transfer Abort Flag
 
+#if ((DAP_SWD != 0) && (TIMESTAMP_CLOCK != 0U))
+// Read with value match waiting for its deadline (match_timeout != 0)
+static struct {
+  uint8_t   active;             // Resume the request at the match transfer
+  uint8_t   count;              // Transfers completed before the match
+  uint16_t  remaining;          // Transfers left including the match
+  uint16_t  request;            // Offset of the match transfer in the request
+  uint16_t  response;           // Response bytes stored before the match
+  uint32_t  start;              // Time of the first poll
+  uint32_t  last;               // Time of the last poll
+} MatchPending;
+#endif
+
 
 static const char DAP_FW_Ver [] = DAP_FW_VER;
 
@@ -223,6 +239,12 @@ static uint32_t DAP_Connect(const uint8_t *request, uint8_t *response) {
     case DAP_PORT_SWD:
       DAP_Data.debug_port = DAP_PORT_SWD;
       PORT_SWD_SETUP();
+#if (DAP_SHADOW != 0)
+      SWD_ShadowInvalidate();
+#endif
+#if (TIMESTAMP_CLOCK != 0U)
+      MatchPending.active = 0U;
+#endif
       break;
 #endif
 #if (DAP_JTAG != 0)
@@ -404,6 +426,9 @@ static uint32_t DAP_SWJ_Clock(const uint8_t *request, uint8_t *response) {
 
     DAP_Data.clock_delay = delay;
   }
+#if (DAP_JTAG != 0)
+  JTAG_SetClock(clock);
+#endif
 
   *response = DAP_OK;
 #else
@@ -663,6 +688,7 @@ static uint32_t DAP_TransferConfigure(const uint8_t *request, uint8_t *response)
 //   response: pointer to response data
 //   return:   number of bytes in response (lower 16 bits)
 //             number of bytes in request (upper 16 bits)
+//             0 = value match pending, process the request again later
 #if (DAP_SWD != 0)
 static uint32_t DAP_SWD_Transfer(const uint8_t *request, uint8_t *response) {
   const
@@ -689,14 +715,34 @@ static uint32_t DAP_SWD_Transfer(const uint8_t *request, uint8_t *response) {
   response_head  = response;
   response      += 2;
 
-  DAP_TransferAbort = 0U;
-
   post_read   = 0U;
   check_write = 0U;
 
-  request++;            // Ignore DAP index
+#if (TIMESTAMP_CLOCK != 0U)
+  if (MatchPending.active) {
+    // Continue at the pending value match, earlier transfers are done
+    if (((TIMESTAMP_GET() - MatchPending.last) <
+         (DAP_Data.transfer.match_interval * (TIMESTAMP_CLOCK / 1000000U))) &&
+        !DAP_TransferAbort) {
+      return (0U);
+    }
+    MatchPending.active = 0U;
+    request        = request_head  + MatchPending.request;
+    request_count  = MatchPending.remaining;
+    response      += MatchPending.response;
+    response_count = MatchPending.count;
+  } else
+#endif
+  {
+    DAP_TransferAbort = 0U;
+#if (TIMESTAMP_CLOCK != 0U)
+    MatchPending.start = TIMESTAMP_GET();
+#endif
 
-  request_count = *request++;
+    request++;          // Ignore DAP index
+
+    request_count = *request++;
+  }
 
   for (; request_count != 0U; request_count--) {
     request_value = *request++;
@@ -746,6 +792,11 @@ static uint32_t DAP_SWD_Transfer(const uint8_t *request, uint8_t *response) {
                       (uint32_t)(*(request+3) << 24);
         request += 4;
         match_retry = DAP_Data.transfer.match_retry;
+#if (TIMESTAMP_CLOCK != 0U)
+        if (DAP_Data.transfer.match_timeout != 0U) {
+          match_retry = 0U;     // One read per poll interval
+        }
+#endif
         if ((request_value & DAP_TRANSFER_APnDP) != 0U) {
           // Post AP read
           retry = DAP_Data.transfer.retry_count;
@@ -766,6 +817,23 @@ static uint32_t DAP_SWD_Transfer(const uint8_t *request, uint8_t *response) {
             break;
           }
         } while (((data & DAP_Data.transfer.match_mask) != match_value) && match_retry-- && !DAP_TransferAbort);
+#if (TIMESTAMP_CLOCK != 0U)
+        if (((data & DAP_Data.transfer.match_mask) != match_value) &&
+            (response_value == DAP_TRANSFER_OK) && (DAP_Data.transfer.match_timeout != 0U) &&
+            !DAP_Data.nested && !DAP_TransferAbort) {
+          MatchPending.last = TIMESTAMP_GET();
+          if ((MatchPending.last - MatchPending.start) <
+              (DAP_Data.transfer.match_timeout * (TIMESTAMP_CLOCK / 1000U))) {
+            // Poll again later, the main loop keeps running meanwhile
+            MatchPending.active    = 1U;
+            MatchPending.count     = (uint8_t)response_count;
+            MatchPending.remaining = (uint16_t)request_count;
+            MatchPending.request   = (uint16_t)((request - 5) - request_head);
+            MatchPending.response  = (uint16_t)((response - response_head) - 2);
+            return (0U);
+          }
+        }
+#endif
         if ((data & DAP_Data.transfer.match_mask) != match_value) {
           response_value |= DAP_TRANSFER_MISMATCH;
         }
@@ -851,6 +919,12 @@ static uint32_t DAP_SWD_Transfer(const uint8_t *request, uint8_t *response) {
         // Write match mask
         DAP_Data.transfer.match_mask = data;
         response_value = DAP_TRANSFER_OK;
+#if (DAP_SHADOW != 0)
+      } else if (((request_value & DAP_TRANSFER_TIMESTAMP) == 0U) &&
+                 SWD_ShadowMatch(request_value, data)) {
+        // Register already holds the value (SELECT, CSW or predicted TAR)
+        response_value = DAP_TRANSFER_OK;
+#endif
       } else {
         // Write DP/AP register
         retry = DAP_Data.transfer.retry_count;
@@ -1610,7 +1684,7 @@ static uint32_t DAP_WriteAbort(const uint8_t *request, uint8_t *response) {
 //   response: pointer to response data
 //   return:   number of bytes in response (lower 16 bits)
 //             number of bytes in request (upper 16 bits)
- uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response) {
+__WEAK uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response) {
   (void)request;
   *response = ID_DAP_Invalid;
   return ((1U << 16) | 1U);
@@ -1622,7 +1696,7 @@ static uint32_t DAP_WriteAbort(const uint8_t *request, uint8_t *response) {
 //   response: pointer to response data
 //   return:   number of bytes in response (lower 16 bits)
 //             number of bytes in request (upper 16 bits)
- uint32_t DAP_ProcessVendorCommandEx(const uint8_t *request, uint8_t *response) {
+__WEAK uint32_t DAP_ProcessVendorCommandEx(const uint8_t *request, uint8_t *response) {
   *response = ID_DAP_Invalid;
   return ((1U << 16) | 1U);
 }
@@ -1702,6 +1776,9 @@ uint32_t DAP_ProcessCommand(const uint8_t *request, uint8_t *response) {
       break;
     case ID_DAP_Transfer:
       num = DAP_Transfer(request, response);
+      if (num == 0U) {
+        return (0U);            // Value match pending, process the request again later
+      }
       break;
     case ID_DAP_TransferBlock:
       num = DAP_TransferBlock(request, response);
@@ -1757,12 +1834,16 @@ uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response) {
     cnt = *request++;
     *response++ = (uint8_t)cnt;
     num = (2U << 16) | 2U;
+    // A command cannot be resumed inside the batch, long-poll commands
+    // complete at once as if their timeout had expired
+    DAP_Data.nested = 1U;
     while (cnt--) {
       n = DAP_ProcessCommand(request, response);
       num += n;
       request  += (uint16_t)(n >> 16);
       response += (uint16_t) n;
     }
+    DAP_Data.nested = 0U;
     return (num);
   }
 
@@ -1775,10 +1856,16 @@ void DAP_Setup(void) {
 
   // Default settings
   DAP_Data.debug_port  = 0U;
+  DAP_Data.nested      = 0U;
   DAP_Data.transfer.idle_cycles = 0U;
   DAP_Data.transfer.retry_count = 100U;
   DAP_Data.transfer.match_retry = 0U;
   DAP_Data.transfer.match_mask  = 0x00000000U;
+  DAP_Data.transfer.match_timeout  = 0U;
+  DAP_Data.transfer.match_interval = 0U;
+#if ((DAP_SWD != 0) && (TIMESTAMP_CLOCK != 0U))
+  MatchPending.active = 0U;
+#endif
 #if (DAP_SWD != 0)
   DAP_Data.swd_conf.turnaround  = 1U;
   DAP_Data.swd_conf.data_phase  = 0U;
@@ -103,6 +103,26 @@
 #define ID_DAP_Vendor30                 0x9EU
 #define ID_DAP_Vendor31                 0x9FU
 
+// Probe specific Vendor Command IDs
+#define ID_DAP_SWO_Filter               ID_DAP_Vendor0
+#define ID_DAP_JTAG_Discover            ID_DAP_Vendor1
+#define ID_DAP_XSVF                     ID_DAP_Vendor2
+#define ID_DAP_CoreContext              ID_DAP_Vendor3
+#define ID_DAP_HaltWatch                ID_DAP_Vendor4
+#define ID_DAP_HaltEvent                ID_DAP_Vendor5
+#define ID_DAP_MemSample                ID_DAP_Vendor6
+#define ID_DAP_Profile                  ID_DAP_Vendor7
+#define ID_DAP_ProfileRead              ID_DAP_Vendor8
+#define ID_DAP_TransferMatch            ID_DAP_Vendor9
+#define ID_DAP_MemRead                  ID_DAP_Vendor10
+#define ID_DAP_MemWrite                 ID_DAP_Vendor11
+#define ID_DAP_FlashStart               ID_DAP_Vendor12
+#define ID_DAP_FlashData                ID_DAP_Vendor13
+#define ID_DAP_FlashEnd                 ID_DAP_Vendor14
+#define ID_DAP_FlashPlan                ID_DAP_Vendor15
+#define ID_DAP_StandaloneWrite          ID_DAP_Vendor16
+#define ID_DAP_StandaloneRun            ID_DAP_Vendor17
+
 // DAP Extended range of Vendor Command IDs
 
 #define ID_DAP_VendorExFirst            0xA0U
@@ -174,6 +194,30 @@
 #define DAP_SWO_STREAM_ERROR            (1U<<6)
 #define DAP_SWO_BUFFER_OVERRUN          (1U<<7)
 
+// Core Context Request
+#define CORE_CONTEXT_WRITE              (1U<<0)
+
+// Core Context Register Mask (bits 0..20 = DCRSR REGSEL, 0x13 is reserved)
+#define CORE_CONTEXT_CORE               0x0017FFFFU     // R0..R15, xPSR, MSP, PSP, CONTROL/PRIMASK
+#define CORE_CONTEXT_FAULT              0x1F000000U     // CFSR, HFSR, DFSR, MMFAR, BFAR
+#define CORE_CONTEXT_FAULT_POS          24U
+
+// XSVF Player Control
+#define XSVF_CONTROL_START              (1U<<0)
+
+// XSVF Player State
+#define XSVF_STATE_IDLE                 0U
+#define XSVF_STATE_RUNNING              1U
+#define XSVF_STATE_COMPLETE             2U
+#define XSVF_STATE_ERROR                3U
+
+// XSVF Player Error
+#define XSVF_ERROR_NONE                 0U
+#define XSVF_ERROR_TDO                  1U      // TDO mismatch after all retries
+#define XSVF_ERROR_UNSUPPORTED          2U      // Unsupported instruction
+#define XSVF_ERROR_SIZE                 3U      // Shift length exceeds XSVF_MAX_BITS
+#define XSVF_ERROR_FORMAT               4U      // Invalid TAP state
+
 
 // Debug Port Register Addresses
 #define DP_IDCODE                       0x00U   // IDCODE Register (SW Read only)
@@ -209,7 +253,8 @@
 typedef struct {
   uint8_t     debug_port;                       // Debug Port
   uint8_t     fast_clock;                       // Fast Clock Flag
-  uint8_t     padding[2];
+  uint8_t     nested;                           // Inside ID_DAP_ExecuteCommands: no long-poll
+  uint8_t     padding[1];
   uint32_t   clock_delay;                       // Clock Delay
   uint32_t     timestamp;                       // Last captured Timestamp
   struct {                                      // Transfer Configuration
@@ -218,12 +263,15 @@ typedef struct {
     uint16_t  retry_count;                      // Number of retries after WAIT response
     uint16_t  match_retry;                      // Number of retries if read value does not match
     uint32_t  match_mask;                       // Match Mask
+    uint16_t  match_timeout;                    // Match deadline in ms (0 = match_retry only)
+    uint16_t  match_interval;                   // Match poll interval in us
   } transfer;
 #if (DAP_SWD != 0)
   struct {                                      // SWD Configuration
     uint8_t    turnaround;                      // Turnaround period
     uint8_t    data_phase;                      // Always generate Data Phase
   } swd_conf;
+  uint32_t    dp_select;                        // Last DP SELECT value written
 #endif
 #if (DAP_JTAG != 0)
   struct {                                      // JTAG Device Chain
@@ -251,11 +299,15 @@ extern "C"
 extern void     SWJ_Sequence    (uint32_t count, const uint8_t *data);
 extern void     SWD_Sequence    (uint32_t info,  const uint8_t *swdo, uint8_t *swdi);
 extern void     JTAG_Sequence   (uint32_t info,  const uint8_t *tdi,  uint8_t *tdo);
+extern void     JTAG_SetClock   (uint32_t clock);
 extern void     JTAG_IR         (uint32_t ir);
 extern uint32_t JTAG_ReadIDCode (void);
+extern uint32_t JTAG_ScanChain  (uint32_t *idcode, uint8_t *ir_length);
 extern void     JTAG_WriteAbort (uint32_t data);
 extern uint8_t  JTAG_Transfer   (uint32_t request, uint32_t *data);
 extern uint8_t  SWD_Transfer    (uint32_t request, uint32_t *data);
+extern void     SWD_ShadowInvalidate (void);
+extern uint32_t SWD_ShadowMatch      (uint32_t request, uint32_t data);
 
 extern void     Delayms         (uint32_t delay);
 
@@ -266,10 +318,14 @@ extern uint32_t SWO_Control        (const uint8_t *request, uint8_t *response);
 extern uint32_t SWO_Status                                 (uint8_t *response);
 extern uint32_t SWO_ExtendedStatus (const uint8_t *request, uint8_t *response);
 extern uint32_t SWO_Data           (const uint8_t *request, uint8_t *response);
+extern uint32_t SWO_Filter         (const uint8_t *request, uint8_t *response);
 
 extern void     SWO_QueueTransfer    (uint8_t *buf, uint32_t num);
 extern void     SWO_AbortTransfer    (void);
 extern void     SWO_TransferComplete (void);
+extern uint32_t SWO_StreamActive     (void);
+extern uint8_t  Sample_QueueTransfer (uint8_t *buf, uint32_t num);
+extern void     SWO_Process          (void);
 
 extern uint32_t UART_SWO_Mode     (uint32_t enable);
 extern uint32_t UART_SWO_Baudrate (uint32_t baudrate);
@@ -283,6 +339,8 @@ extern uint32_t Manchester_SWO_Control  (uint32_t active);
 extern void     Manchester_SWO_Capture  (uint8_t *buf, uint32_t num);
 extern uint32_t Manchester_SWO_GetCount (void);
 
+extern uint32_t XSVF_Command (const uint8_t *request, uint8_t *response);
+
 extern uint32_t DAP_ProcessVendorCommand (const uint8_t *request, uint8_t *response);
 extern uint32_t DAP_ProcessCommand       (const uint8_t *request, uint8_t *response);
 extern uint32_t DAP_ExecuteCommand       (const uint8_t *request, uint8_t *response);
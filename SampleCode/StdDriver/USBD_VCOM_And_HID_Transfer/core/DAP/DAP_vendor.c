@@ -0,0 +1,627 @@
+/*
+ * Copyright (c) 2013-2017 ARM Limited. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ----------------------------------------------------------------------
+ *
+ * $Date:        1. December 2017
+ * $Revision:    V2.0.0
+ *
+ * Project:      CMSIS-DAP Source
+ * Title:        DAP_vendor.c CMSIS-DAP Vendor Commands
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include "DAP_config.h"
+#include "DAP.h"
+#include "SWD_host.h"
+#include "debug_cm.h"
+#include "SWD_watch.h"
+#include "SWD_sample.h"
+#include "SWD_profile.h"
+#include "SWD_program.h"
+#include "SWD_standalone.h"
+
+//**************************************************************************************************
+/**
+\defgroup DAP_Vendor_Adapt_gr Adapt Vendor Commands
+\ingroup DAP_Vendor_gr
+@{
+
+The file DAP_vendor.c provides template source code for extension of a Debug Unit with
+Vendor Commands. Copy this file to the project folder of the Debug Unit and add the
+file to the MDK-ARM project under the file group Configuration.
+*/
+
+#if ((DAP_JTAG != 0) && (DAP_JTAG_CACHE_ADDR != 0U))
+
+// Scan chain cache: log of entries in one APROM page, the latest match wins.
+// The magic word of an entry is written last, entries without it are skipped.
+
+#if ((DAP_JTAG_DEV_CNT % 4U) != 0U)
+#error "DAP_JTAG_DEV_CNT must be a multiple of 4 for the scan chain cache!"
+#endif
+#if (DAP_JTAG_CACHE_ADDR < APROM_CODE_SIZE)
+#error "The scan chain cache page must lie above APROM_CODE_SIZE!"
+#endif
+
+#define JTAG_CACHE_MAGIC        0x4A544147U     // "JTAG"
+#define JTAG_CACHE_ENTRIES      (FMC_FLASH_PAGE_SIZE / sizeof(JTAG_CacheEntry_t))
+
+typedef struct {
+  uint32_t magic;
+  uint32_t count;
+  uint32_t idcode[DAP_JTAG_DEV_CNT];
+  uint8_t  ir_length[DAP_JTAG_DEV_CNT];
+} JTAG_CacheEntry_t;
+
+// Find cached scan chain by IDCODE set
+//   idcode: pointer to IDCODEs
+//   count:  number of devices
+//   return: cache entry or NULL
+static const JTAG_CacheEntry_t *JTAG_CacheFind (const uint32_t *idcode, uint32_t count) {
+  const JTAG_CacheEntry_t *entry;
+  const JTAG_CacheEntry_t *found;
+  uint32_t n, k;
+
+  entry = (const JTAG_CacheEntry_t *)DAP_JTAG_CACHE_ADDR;
+  found = NULL;
+  for (n = 0U; n < JTAG_CACHE_ENTRIES; n++, entry++) {
+    if ((entry->magic != JTAG_CACHE_MAGIC) || (entry->count != count)) {
+      continue;
+    }
+    for (k = 0U; (k < count) && (entry->idcode[k] == idcode[k]); k++);
+    if (k == count) {
+      found = entry;
+    }
+  }
+  return (found);
+}
+
+// Check that a cache entry is still erased
+//   entry:  cache entry
+//   return: 1 = erased, 0 = written (also partly, by a failed store)
+static uint32_t JTAG_CacheBlank (const JTAG_CacheEntry_t *entry) {
+  const uint32_t *data;
+  uint32_t n;
+
+  data = (const uint32_t *)entry;
+  for (n = 0U; n < (sizeof(JTAG_CacheEntry_t) / 4U); n++) {
+    if (data[n] != 0xFFFFFFFFU) {
+      return (0U);
+    }
+  }
+  return (1U);
+}
+
+// Store scan chain into cache
+//   idcode:    pointer to IDCODEs
+//   ir_length: pointer to IR lengths
+//   count:     number of devices
+//   return:    none
+static void JTAG_CacheStore (const uint32_t *idcode, const uint8_t *ir_length, uint32_t count) {
+  const JTAG_CacheEntry_t *entry;
+  JTAG_CacheEntry_t cache;
+  const uint32_t *data;
+  uint32_t addr;
+  uint32_t ok;
+  uint32_t n;
+
+  entry = JTAG_CacheFind(idcode, count);
+  if ((entry != NULL) && (memcmp(entry->ir_length, ir_length, count) == 0)) {
+    return;
+  }
+
+  memset(&cache, 0, sizeof(cache));
+  cache.magic = JTAG_CACHE_MAGIC;
+  cache.count = count;
+  memcpy(cache.idcode,    idcode,    count * sizeof(uint32_t));
+  memcpy(cache.ir_length, ir_length, count);
+
+  // First free entry, page is erased when full
+  entry = (const JTAG_CacheEntry_t *)DAP_JTAG_CACHE_ADDR;
+  for (n = 0U; (n < JTAG_CACHE_ENTRIES) && !JTAG_CacheBlank(entry); n++, entry++);
+
+  SYS_UnlockReg();
+  FMC_Open();
+  FMC_ENABLE_AP_UPDATE();
+  ok = 1U;
+  if (n == JTAG_CACHE_ENTRIES) {
+    ok = (FMC_Erase(DAP_JTAG_CACHE_ADDR) == 0) ? 1U : 0U;
+    n  = 0U;
+  }
+  addr = DAP_JTAG_CACHE_ADDR + (n * sizeof(JTAG_CacheEntry_t));
+  data = (const uint32_t *)&cache;
+  // Magic word last, a failed store leaves an entry that is never used
+  for (n = 1U; ok && (n < (sizeof(cache) / 4U)); n++) {
+    ok = (FMC_Write(addr + (n * 4U), data[n]) == 0) ? 1U : 0U;
+  }
+  if (ok) {
+    FMC_Write(addr, data[0]);
+  }
+  FMC_DISABLE_AP_UPDATE();
+  FMC_Close();
+  SYS_LockReg();
+}
+
+#endif
+
+#if (DAP_JTAG != 0)
+
+// Process JTAG Discover command and prepare response
+//   request:  pointer to request data
+//             [0] flags: bit0 = ignore cache, bit1 = store ID_DAP_JTAG_Configure setting
+//   response: pointer to response data
+//             status, source (0 = scan, 1 = cache), count, count * (IR length, IDCODE)
+//             DAP_ERROR without devices unless the JTAG port is connected
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+static uint32_t DAP_JTAG_Discover (const uint8_t *request, uint8_t *response) {
+  uint32_t idcode[DAP_JTAG_DEV_CNT];
+  uint8_t  ir_length[DAP_JTAG_DEV_CNT];
+  uint32_t flags;
+  uint32_t count;
+  uint32_t source;
+  uint32_t bits;
+  uint32_t n;
+#if (DAP_JTAG_CACHE_ADDR != 0U)
+  const JTAG_CacheEntry_t *entry;
+#endif
+
+  if (DAP_Data.debug_port != DAP_PORT_JTAG) {
+    response[0] = DAP_ERROR;
+    response[1] = 0U;
+    response[2] = 0U;
+    return ((1U << 16) | 3U);
+  }
+
+  flags  = *request;
+  source = 0U;
+  count  = JTAG_ScanChain(idcode, NULL);
+
+  if (count != 0U) {
+    if (flags & 0x02U) {
+      // Host confirmed configuration for this chain
+      if (DAP_Data.jtag_dev.count == count) {
+        memcpy(ir_length, DAP_Data.jtag_dev.ir_length, count);
+      } else {
+        count = 0U;
+      }
+    } else {
+#if (DAP_JTAG_CACHE_ADDR != 0U)
+      entry = ((flags & 0x01U) == 0U) ? JTAG_CacheFind(idcode, count) : NULL;
+      if (entry != NULL) {
+        memcpy(ir_length, entry->ir_length, count);
+        source = 1U;
+      } else
+#endif
+      {
+        count = JTAG_ScanChain(idcode, ir_length);
+      }
+    }
+  }
+
+  for (n = 0U; n < count; n++) {
+    if (ir_length[n] == 0U) {
+      break;
+    }
+  }
+  if ((count == 0U) || (n != count)) {
+    *response++ = DAP_ERROR;
+  } else {
+#if (DAP_JTAG_CACHE_ADDR != 0U)
+    if (source == 0U) {
+      JTAG_CacheStore(idcode, ir_length, count);
+    }
+#endif
+    // Same as ID_DAP_JTAG_Configure
+    DAP_Data.jtag_dev.count = (uint8_t)count;
+    bits = 0U;
+    for (n = 0U; n < count; n++) {
+      DAP_Data.jtag_dev.ir_length[n] =  ir_length[n];
+      DAP_Data.jtag_dev.ir_before[n] = (uint16_t)bits;
+      bits += ir_length[n];
+    }
+    for (n = 0U; n < count; n++) {
+      bits -= ir_length[n];
+      DAP_Data.jtag_dev.ir_after[n] = (uint16_t)bits;
+    }
+    *response++ = DAP_OK;
+  }
+
+  *response++ = (uint8_t)source;
+  *response++ = (uint8_t)count;
+  for (n = 0U; n < count; n++) {
+    *response++ = ir_length[n];
+    *response++ = (uint8_t)(idcode[n] >>  0);
+    *response++ = (uint8_t)(idcode[n] >>  8);
+    *response++ = (uint8_t)(idcode[n] >> 16);
+    *response++ = (uint8_t)(idcode[n] >> 24);
+  }
+
+  return ((1U << 16) | (3U + (count * 5U)));
+}
+
+#endif
+
+#if (DAP_SWD != 0)
+
+#define SCB_CFSR_ADDR           0xE000ED28U     // CFSR, HFSR, DFSR, MMFAR, BFAR follow
+
+#define CORE_CONTEXT_READ_MAX   ((DAP_PACKET_SIZE - 2U) / 4U)   // Registers per read response
+#define CORE_CONTEXT_WRITE_MAX  ((DAP_PACKET_SIZE - 6U) / 4U)   // Registers per write request
+
+// Process Core Context command and prepare response
+//   request:  pointer to request data
+//             [0] control: bit0 = write
+//             [1..4] register mask (CORE_CONTEXT_CORE, CORE_CONTEXT_FAULT)
+//             write: register values in ascending mask bit order
+//             At most CORE_CONTEXT_WRITE_MAX registers are written and
+//             CORE_CONTEXT_READ_MAX registers are read per command.
+//   response: pointer to response data
+//             status, read: register values in ascending mask bit order
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+static uint32_t DAP_CoreContext (const uint8_t *request, uint8_t *response) {
+  uint32_t val[CORE_CONTEXT_READ_MAX];
+  uint32_t fault[5];
+  uint32_t control;
+  uint32_t mask;
+  uint32_t core;
+  uint32_t count;
+  uint32_t n, k;
+  uint32_t ok;
+
+  control = request[0];
+  mask    = (uint32_t)(request[1] <<  0) |
+            (uint32_t)(request[2] <<  8) |
+            (uint32_t)(request[3] << 16) |
+            (uint32_t)(request[4] << 24);
+  core    = mask & CORE_CONTEXT_CORE;
+
+  for (count = 0U, n = mask; n != 0U; n &= n - 1U) {
+    count++;
+  }
+  if ((DAP_Data.debug_port != DAP_PORT_SWD) || (mask & ~(CORE_CONTEXT_CORE | CORE_CONTEXT_FAULT)) ||
+      (count > ((control & CORE_CONTEXT_WRITE) ? CORE_CONTEXT_WRITE_MAX : CORE_CONTEXT_READ_MAX)) ||
+      (count == 0U)) {
+    *response = DAP_ERROR;
+    return ((5U << 16) | 1U);
+  }
+
+  // The host may have changed SELECT/CSW through DAP_Transfer
+  swd_invalidate_state();
+
+  if (control & CORE_CONTEXT_WRITE) {
+    request += 5U;
+    for (n = 0U; n < count; n++) {
+      val[n] = (uint32_t)(request[0] <<  0) |
+               (uint32_t)(request[1] <<  8) |
+               (uint32_t)(request[2] << 16) |
+               (uint32_t)(request[3] << 24);
+      request += 4U;
+    }
+    ok = swd_write_core_registers(core, val);
+    // Fault status registers are write-one-to-clear
+    for (n = 0U, k = 0U; ok && (n < 32U); n++) {
+      if (mask & (1U << n)) {
+        if (n >= CORE_CONTEXT_FAULT_POS) {
+          ok = swd_write_word(SCB_CFSR_ADDR + ((n - CORE_CONTEXT_FAULT_POS) * 4U), val[k]);
+        }
+        k++;
+      }
+    }
+    if (!ok) {
+      // Leave the DP usable for the next command
+      swd_write_dp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
+    }
+    *response = ok ? DAP_OK : DAP_ERROR;
+    return (((5U + (count * 4U)) << 16) | 1U);
+  }
+
+  ok = swd_read_core_registers(core, val);
+  if (ok && (mask & CORE_CONTEXT_FAULT)) {
+    // One block read for all fault registers
+    ok = swd_read_memory(SCB_CFSR_ADDR, (uint8_t *)fault, sizeof(fault));
+    // Fault registers follow the core registers
+    for (k = 0U, n = core; n != 0U; n &= n - 1U) {
+      k++;
+    }
+    for (n = CORE_CONTEXT_FAULT_POS; n < 32U; n++) {
+      if (mask & (1U << n)) {
+        val[k++] = fault[n - CORE_CONTEXT_FAULT_POS];
+      }
+    }
+  }
+  if (!ok) {
+    swd_write_dp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
+    *response = DAP_ERROR;
+    return ((5U << 16) | 1U);
+  }
+
+  *response++ = DAP_OK;
+  for (n = 0U; n < count; n++) {
+    *response++ = (uint8_t)(val[n] >>  0);
+    *response++ = (uint8_t)(val[n] >>  8);
+    *response++ = (uint8_t)(val[n] >> 16);
+    *response++ = (uint8_t)(val[n] >> 24);
+  }
+
+  return ((5U << 16) | (1U + (count * 4U)));
+}
+
+#define MEM_READ_MAX            (DAP_PACKET_SIZE - 3U)  // Data bytes per Memory Read response
+#define MEM_WRITE_MAX           (DAP_PACKET_SIZE - 7U)  // Data bytes per Memory Write request
+
+// Check memory access parameters
+//   access: 0 = any (unaligned allowed), 1, 2 or 4 bytes per access
+static uint32_t DAP_MemCheck (uint32_t address, uint32_t access) {
+  if (DAP_Data.debug_port != DAP_PORT_SWD) {
+    return (0U);
+  }
+  if (access == 0U) {
+    return (1U);
+  }
+  if ((access != 1U) && (access != 2U) && (access != 4U)) {
+    return (0U);
+  }
+  return (((address & (access - 1U)) == 0U) ? 1U : 0U);
+}
+
+// Process Memory Read command and prepare response
+//   request:  pointer to request data
+//             [0..3] address
+//             [4..5] number of bytes wanted
+//             [6] access size: 0 = any, 1, 2 or 4 bytes
+//   response: pointer to response data
+//             status, number of bytes read, data
+//             As many bytes as fit in the packet are read, the host
+//             continues at address + number of bytes read.
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+static uint32_t DAP_MemRead (const uint8_t *request, uint8_t *response) {
+  uint32_t address;
+  uint32_t count;
+  uint32_t access;
+  uint32_t max;
+  uint32_t ok;
+
+  address = (uint32_t)(request[0] <<  0) |
+            (uint32_t)(request[1] <<  8) |
+            (uint32_t)(request[2] << 16) |
+            (uint32_t)(request[3] << 24);
+  count   = (uint32_t)(request[4] <<  0) |
+            (uint32_t)(request[5] <<  8);
+  access  = request[6];
+
+  max = MEM_READ_MAX;
+  if (access > 1U) {
+    max &= ~(access - 1U);
+  }
+  if (count > max) {
+    count = max;
+  }
+
+  if (!DAP_MemCheck(address, access) || ((access > 1U) && (count & (access - 1U)))) {
+    response[0] = DAP_ERROR;
+    response[1] = 0U;
+    return ((7U << 16) | 2U);
+  }
+
+  // The host may have changed SELECT/CSW through DAP_Transfer
+  swd_invalidate_state();
+
+  ok = 1U;
+  if (count != 0U) {
+    if (access == 0U) {
+      ok = swd_read_memory(address, &response[2], count);
+    } else {
+      ok = swd_read_memory_sized(address, &response[2], count, access);
+    }
+  }
+  if (!ok) {
+    // Leave the DP usable for the next command
+    swd_write_dp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
+    count = 0U;
+  }
+
+  response[0] = ok ? DAP_OK : DAP_ERROR;
+  response[1] = (uint8_t)count;
+  return ((7U << 16) | (2U + count));
+}
+
+// Process Memory Write command and prepare response
+//   request:  pointer to request data
+//             [0..3] address
+//             [4] access size: 0 = any, 1, 2 or 4 bytes
+//             [5] number of data bytes
+//             [6..] data
+//   response: pointer to response data
+//             status
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+static uint32_t DAP_MemWrite (const uint8_t *request, uint8_t *response) {
+  uint8_t *data;
+  uint32_t address;
+  uint32_t count;
+  uint32_t access;
+  uint32_t ok;
+
+  address = (uint32_t)(request[0] <<  0) |
+            (uint32_t)(request[1] <<  8) |
+            (uint32_t)(request[2] << 16) |
+            (uint32_t)(request[3] << 24);
+  access  = request[4];
+  count   = request[5];
+
+  if (count > MEM_WRITE_MAX) {
+    *response = DAP_ERROR;
+    return (((6U + count) << 16) | 1U);
+  }
+  if (!DAP_MemCheck(address, access) || ((access > 1U) && (count & (access - 1U)))) {
+    *response = DAP_ERROR;
+    return (((6U + count) << 16) | 1U);
+  }
+
+  // The host may have changed SELECT/CSW through DAP_Transfer
+  swd_invalidate_state();
+
+  data = (uint8_t *)&request[6];         // Not modified by swd_write_memory
+
+  ok = 1U;
+  if (count != 0U) {
+    if (access == 0U) {
+      ok = swd_write_memory(address, data, count);
+    } else {
+      ok = swd_write_memory_sized(address, data, count, access);
+    }
+  }
+  if (!ok) {
+    // Leave the DP usable for the next command
+    swd_write_dp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
+  }
+
+  *response = ok ? DAP_OK : DAP_ERROR;
+
+  return (((6U + count) << 16) | 1U);
+}
+
+#if (TIMESTAMP_CLOCK != 0U)
+// Process Transfer Match command and prepare response
+//   Reads with value match in DAP_Transfer then poll against a deadline
+//   instead of spinning for match_retry reads; the probe keeps servicing
+//   VCOM and background work between polls. Inside ID_DAP_ExecuteCommands
+//   the match is read once, as if the deadline had passed.
+//   request:  pointer to request data
+//             [0..1] deadline in ms (0 = use match_retry of ID_DAP_TransferConfigure)
+//             [2..3] poll interval in us
+//   response: pointer to response data
+//             status
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+static uint32_t DAP_TransferMatch (const uint8_t *request, uint8_t *response) {
+
+  DAP_Data.transfer.match_timeout  = (uint16_t) *(request+0) |
+                                     (uint16_t)(*(request+1) << 8);
+  DAP_Data.transfer.match_interval = (uint16_t) *(request+2) |
+                                     (uint16_t)(*(request+3) << 8);
+
+  *response = DAP_OK;
+  return ((4U << 16) | 1U);
+}
+#endif
+
+#endif
+
+/** Process DAP Vendor Command and prepare Response Data
+\param request   pointer to request data
+\param response  pointer to response data
+\return          number of bytes in response (lower 16 bits)
+                 number of bytes in request (upper 16 bits)
+                 0 = long-poll command pending, process the request again later
+*/
+uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response) {
+  uint32_t num = (1U << 16) | 1U;
+  uint32_t n;
+
+  *response++ = *request;        // copy Command ID
+
+  switch (*request++) {          // first byte in request is Command ID
+#if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
+    case ID_DAP_SWO_Filter:
+      num += SWO_Filter(request, response);
+      break;
+#endif
+#if (DAP_JTAG != 0)
+    case ID_DAP_JTAG_Discover:
+      num += DAP_JTAG_Discover(request, response);
+      break;
+#endif
+#if (DAP_SWD != 0)
+    case ID_DAP_CoreContext:
+      num += DAP_CoreContext(request, response);
+      break;
+    case ID_DAP_HaltWatch:
+      num += SWD_Watch_Config(request, response);
+      break;
+    case ID_DAP_HaltEvent:
+      n = SWD_Watch_Event(request, response);
+      if (n == 0U) {
+        return (0U);            // Long-poll: no response yet
+      }
+      num += n;
+      break;
+#if (TIMESTAMP_CLOCK != 0U)
+    case ID_DAP_TransferMatch:
+      num += DAP_TransferMatch(request, response);
+      break;
+#endif
+    case ID_DAP_MemRead:
+      num += DAP_MemRead(request, response);
+      break;
+    case ID_DAP_MemWrite:
+      num += DAP_MemWrite(request, response);
+      break;
+    case ID_DAP_FlashStart:
+      num += SWD_Program_Start(request, response);
+      break;
+    case ID_DAP_FlashPlan:
+      num += SWD_Program_Plan(request, response);
+      break;
+    case ID_DAP_FlashData:
+      num += SWD_Program_Data(request, response);
+      break;
+    case ID_DAP_FlashEnd:
+      num += SWD_Program_End(request, response);
+      break;
+#endif
+#if ((DAP_SWD != 0) && (STANDALONE_ADDR != 0U))
+    case ID_DAP_StandaloneWrite:
+      num += SWD_Standalone_Write(request, response);
+      break;
+    case ID_DAP_StandaloneRun:
+      num += SWD_Standalone_Run(request, response);
+      break;
+#endif
+#if ((DAP_SWD != 0) && (SAMPLE_BUFFER_SIZE != 0U) && (SWO_STREAM != 0))
+    case ID_DAP_MemSample:
+      num += SWD_Sample_Config(request, response);
+      break;
+#endif
+#if ((DAP_SWD != 0) && (PROFILE_BUCKETS != 0U))
+    case ID_DAP_Profile:
+      num += SWD_Profile_Config(request, response);
+      break;
+    case ID_DAP_ProfileRead:
+      num += SWD_Profile_Read(request, response);
+      break;
+#endif
+#if ((DAP_JTAG != 0) && (XSVF_MAX_BITS != 0U))
+    case ID_DAP_XSVF:
+      num += XSVF_Command(request, response);
+      break;
+#endif
+
+    default:
+      *(response-1) = ID_DAP_Invalid;
+      break;
+  }
+
+  return (num);
+}
+
+///@}
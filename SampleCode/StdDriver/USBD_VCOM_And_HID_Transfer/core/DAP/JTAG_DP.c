@@ -31,10 +31,10 @@
 
 // JTAG Macros
 
-#define PIN_TCK_SET PIN_SWCLK_TCK_SET
-#define PIN_TCK_CLR PIN_SWCLK_TCK_CLR
-#define PIN_TMS_SET PIN_SWDIO_TMS_SET
-#define PIN_TMS_CLR PIN_SWDIO_TMS_CLR
+#define PIN_TCK_SET PIN_TCK_JTAG_SET
+#define PIN_TCK_CLR PIN_TCK_JTAG_CLR
+#define PIN_TMS_SET PIN_TMS_JTAG_SET
+#define PIN_TMS_CLR PIN_TMS_JTAG_CLR
 
 #define JTAG_CYCLE_TCK()                \
   PIN_TCK_CLR();                        \
@@ -70,6 +70,31 @@
 #if (DAP_JTAG != 0)
 
 
+#if (DAP_JTAG_SPI != 0)
+static uint8_t JTAG_SPI_Ready = 0U;     // SPI shifter runs at the requested TCK
+#define JTAG_SPI_READY() (JTAG_SPI_Ready != 0U)
+#else
+#define JTAG_SPI_READY() 0U
+#define PIN_JTAG_SPI_SHIFT(tdi, n) 0U
+#endif
+
+
+// Set JTAG clock for the SPI shifter
+//   clock:  requested TCK frequency in Hz
+//   return: none
+void JTAG_SetClock (uint32_t clock) {
+#if (DAP_JTAG_SPI != 0)
+  uint32_t actual;
+
+  // Bit-bang when SPI cannot get close enough (too slow for its divider)
+  actual = PORT_JTAG_SPI_CLOCK(clock);
+  JTAG_SPI_Ready = (actual <= (clock + (clock >> 2))) ? 1U : 0U;
+#else
+  (void)clock;
+#endif
+}
+
+
 // Generate JTAG Sequence
 //   info:   sequence information
 //   tdi:    pointer to TDI generated data
@@ -93,6 +118,22 @@ void JTAG_Sequence (uint32_t info, const uint8_t *tdi, uint8_t *tdo) {
   }
 
   while (n) {
+    if (JTAG_SPI_READY() && (n >= 8U)) {
+      // Whole bytes (up to 32 bits) through SPI, TMS stays constant
+      k = (n > 32U) ? 32U : n;
+      i_val = 0U;
+      for (bit = 0U; bit < k; bit += 8U) {
+        i_val |= (uint32_t)(*tdi++) << bit;
+      }
+      o_val = PIN_JTAG_SPI_SHIFT(i_val, k);
+      if (info & JTAG_SEQUENCE_TDO) {
+        for (bit = 0U; bit < k; bit += 8U) {
+          *tdo++ = (uint8_t)(o_val >> bit);
+        }
+      }
+      n -= k;
+      continue;
+    }
     i_val = *tdi++;
     o_val = 0U;
     for (k = 8U; k && n; k--, n--) {
@@ -189,11 +230,15 @@ static uint8_t JTAG_Transfer##speed (uint32_t request, uint32_t *data) {
                                                                                 \
   if (request & DAP_TRANSFER_RnW) {                                             \
     /* Read Transfer */                                                         \
-    val = 0U;                                                                   \
-    for (n = 31U; n; n--) {                                                     \
-      JTAG_CYCLE_TDO(bit);                  /* Get D0..D30 */                   \
-      val  |= bit << 31;                                                        \
-      val >>= 1;                                                                \
+    if (JTAG_SPI_READY()) {                                                     \
+      val = PIN_JTAG_SPI_SHIFT(0U, 31U);    /* Get D0..D30 */                   \
+    } else {                                                                    \
+      val = 0U;                                                                 \
+      for (n = 31U; n; n--) {                                                   \
+        JTAG_CYCLE_TDO(bit);                /* Get D0..D30 */                   \
+        val  |= bit << 31;                                                      \
+        val >>= 1;                                                              \
+      }                                                                         \
     }                                                                           \
     n = DAP_Data.jtag_dev.count - DAP_Data.jtag_dev.index - 1U;                 \
     if (n) {                                                                    \
@@ -212,9 +257,14 @@ static uint8_t JTAG_Transfer##speed (uint32_t request, uint32_t *data) {
   } else {                                                                      \
     /* Write Transfer */                                                        \
     val = *data;                                                                \
-    for (n = 31U; n; n--) {                                                     \
-      JTAG_CYCLE_TDI(val);                  /* Set D0..D30 */                   \
-      val >>= 1;                                                                \
+    if (JTAG_SPI_READY()) {                                                     \
+      PIN_JTAG_SPI_SHIFT(val, 31U);         /* Set D0..D30 */                   \
+      val >>= 31;                                                               \
+    } else {                                                                    \
+      for (n = 31U; n; n--) {                                                   \
+        JTAG_CYCLE_TDI(val);                /* Set D0..D30 */                   \
+        val >>= 1;                                                              \
+      }                                                                         \
     }                                                                           \
     n = DAP_Data.jtag_dev.count - DAP_Data.jtag_dev.index - 1U;                 \
     if (n) {                                                                    \
@@ -262,6 +312,132 @@ JTAG_IR_Function(Slow)
 JTAG_TransferFunction(Slow)
 
 
+// JTAG scan chain discovery
+//   Devices are numbered from TDO (same order as ID_DAP_JTAG_Configure).
+//   idcode:    pointer to IDCODE array (0 for devices without IDCODE)
+//   ir_length: pointer to IR length array (0 when the IR capture pattern is ambiguous),
+//              NULL to read the IDCODEs only
+//   return:    number of devices, 0 when no chain was found
+#define JTAG_SCAN_IR_MAX    256U            /* Maximum total IR length */
+#define JTAG_SCAN_BIT(buf, i) (((buf)[(i) >> 3] >> ((i) & 7U)) & 1U)
+
+uint32_t JTAG_ScanChain (uint32_t *idcode, uint8_t *ir_length) {
+  static uint8_t capture[JTAG_SCAN_IR_MAX / 8U];
+  uint32_t count;
+  uint32_t total;
+  uint32_t bit;
+  uint32_t val;
+  uint32_t n, k;
+
+  PIN_TDI_OUT(1U);
+  PIN_TMS_SET();
+  for (n = 6U; n; n--) {
+    JTAG_CYCLE_TCK();                       /* Test-Logic-Reset */
+  }
+  PIN_TMS_CLR();
+  JTAG_CYCLE_TCK();                         /* Idle */
+
+  // DR after reset: IDCODE (LSB 1) or BYPASS (0), ones from TDI mark the end
+  PIN_TMS_SET();
+  JTAG_CYCLE_TCK();                         /* Select-DR-Scan */
+  PIN_TMS_CLR();
+  JTAG_CYCLE_TCK();                         /* Capture-DR */
+  JTAG_CYCLE_TCK();                         /* Shift-DR */
+
+  count = 0U;
+  for (;;) {
+    JTAG_CYCLE_TDO(bit);
+    if (bit == 0U) {
+      val = 0U;                             /* BYPASS */
+    } else {
+      val = 1U;
+      for (n = 1U; n < 32U; n++) {
+        JTAG_CYCLE_TDO(bit);
+        val |= bit << n;
+      }
+      if (val == 0xFFFFFFFFU) {
+        break;                              /* End of chain */
+      }
+    }
+    if (count == DAP_JTAG_DEV_CNT) {
+      count = 0U;                           /* Too many devices or TDO stuck */
+      break;
+    }
+    idcode[count++] = val;
+  }
+
+  PIN_TMS_SET();
+  JTAG_CYCLE_TCK();                         /* Exit1-DR */
+  JTAG_CYCLE_TCK();                         /* Update-DR */
+  if (ir_length == NULL) {
+    PIN_TMS_CLR();
+    JTAG_CYCLE_TCK();                       /* Idle */
+    return (count);
+  }
+  JTAG_CYCLE_TCK();                         /* Select-DR-Scan */
+  JTAG_CYCLE_TCK();                         /* Select-IR-Scan */
+  PIN_TMS_CLR();
+  JTAG_CYCLE_TCK();                         /* Capture-IR */
+  JTAG_CYCLE_TCK();                         /* Shift-IR */
+
+  // Record IR capture values while filling all IRs with ones
+  for (n = 0U; n < JTAG_SCAN_IR_MAX; n++) {
+    JTAG_CYCLE_TDO(bit);
+    if ((n & 7U) == 0U) {
+      capture[n >> 3] = 0U;
+    }
+    capture[n >> 3] |= (uint8_t)(bit << (n & 7U));
+  }
+
+  // Total IR length: clocks until a zero from TDI appears on TDO
+  PIN_TDI_OUT(0U);
+  for (total = 0U; total < JTAG_SCAN_IR_MAX; total++) {
+    JTAG_CYCLE_TDO(bit);
+    if (bit == 0U) {
+      break;
+    }
+  }
+
+  // Leave all devices in BYPASS
+  PIN_TDI_OUT(1U);
+  for (n = total; n; n--) {
+    JTAG_CYCLE_TCK();
+  }
+  PIN_TMS_SET();
+  JTAG_CYCLE_TCK();                         /* Exit1-IR */
+  JTAG_CYCLE_TCK();                         /* Update-IR */
+  PIN_TMS_CLR();
+  JTAG_CYCLE_TCK();                         /* Idle */
+
+  if ((count == 0U) || (total == JTAG_SCAN_IR_MAX)) {
+    return (0U);
+  }
+
+  // Split total IR by the mandatory capture pattern (LSB first: 1, 0)
+  k = 0U;
+  n = 0U;
+  while ((k < count) && (n + 1U < total) && JTAG_SCAN_BIT(capture, n) && !JTAG_SCAN_BIT(capture, n + 1U)) {
+    val = n;
+    for (n += 2U; n + 1U < total; n++) {
+      if (JTAG_SCAN_BIT(capture, n) && !JTAG_SCAN_BIT(capture, n + 1U)) {
+        break;
+      }
+    }
+    if (n + 1U >= total) {
+      n = total;
+    }
+    ir_length[k++] = (uint8_t)(n - val);
+  }
+  if ((k != count) || (n != total)) {
+    for (k = 0U; k < count; k++) {
+      ir_length[k] = 0U;                    /* Ambiguous */
+    }
+  }
+
+  return (count);
+}
+
+
 // JTAG Read IDCODE register
 //   return: value read
 uint32_t JTAG_ReadIDCode (void) {
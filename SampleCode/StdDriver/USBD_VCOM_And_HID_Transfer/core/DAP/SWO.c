@@ -25,13 +25,12 @@
  *
  *---------------------------------------------------------------------------*/
 
+#include <string.h>
 #include "DAP_config.h"
 #include "DAP.h"
-#if (SWO_UART != 0)
-#include "Driver_USART.h"
-#endif
-#if (SWO_STREAM != 0)
-#include "cmsis_os2.h"
+
+#ifndef __WEAK
+#define __WEAK __attribute__((weak))
 #endif
 
 #if (SWO_STREAM != 0)
@@ -42,33 +41,109 @@
 
 #if (SWO_UART != 0)
 
-#ifndef  SWO_USART_PORT
-#define  SWO_USART_PORT 0           /* USART Port Number */
+#ifndef  SWO_UART_PORT
+#define  SWO_UART_PORT          UART1               /* UART Port (RXD on PA.8) */
+#endif
+#ifndef  SWO_UART_IRQn
+#define  SWO_UART_IRQn          UART13_IRQn         /* UART Interrupt */
+#endif
+#ifndef  SWO_UART_IRQHandler
+#define  SWO_UART_IRQHandler    UART13_IRQHandler   /* UART Interrupt Handler */
+#endif
+#ifndef  SWO_UART_CLOCK
+#define  SWO_UART_CLOCK         __HIRC              /* UART Peripheral Clock */
+#endif
+#ifndef  SWO_UART_PDMA_CH
+#define  SWO_UART_PDMA_CH       0U                  /* PDMA Channel */
+#endif
+#ifndef  SWO_UART_PDMA_REQ
+#define  SWO_UART_PDMA_REQ      PDMA_UART1_RX       /* PDMA Request Source */
+#endif
+
+static uint8_t           USART_Ready = 0U;
+static volatile uint8_t  USART_RxBusy = 0U;  /* PDMA Receive active */
+static volatile uint32_t USART_RxNum;        /* PDMA Receive size */
+
+#if (SWO_UART_AUTOBAUD != 0)
+
+#ifndef  SWO_AUTOBAUD_TIMER
+#define  SWO_AUTOBAUD_TIMER     TIMER3              /* Pulse capture Timer (TM3_EXT on PA.8) */
+#endif
+#ifndef  SWO_AUTOBAUD_CLOCK
+#define  SWO_AUTOBAUD_CLOCK     __HIRC              /* Timer Peripheral Clock */
 #endif
 
-// USART Driver
-#define _USART_Driver_(n)  Driver_USART##n
-#define  USART_Driver_(n) _USART_Driver_(n)
-extern ARM_DRIVER_USART    USART_Driver_(SWO_USART_PORT);
-#define pUSART           (&USART_Driver_(SWO_USART_PORT))
+#define AUTOBAUD_PULSES         64U                 /* Measured pulses */
+#define AUTOBAUD_PULSES_MIN     8U                  /* Minimum pulses for a result */
+#define AUTOBAUD_TIMEOUT        (SWO_AUTOBAUD_CLOCK / 10U)  /* Measurement time limit (100ms) */
+#define AUTOBAUD_WIDTH_MIN      (SWO_AUTOBAUD_CLOCK / (2U * SWO_UART_MAX_BAUDRATE))  /* Glitch */
 
-static uint8_t USART_Ready = 0U;
+static uint16_t AutoBaudPulse[AUTOBAUD_PULSES];     /* Pulse widths (timer ticks) */
+
+#endif
 
 #endif  /* (SWO_UART != 0) */
 
+#if (SWO_MANCHESTER != 0)
+
+#ifndef  SWO_MANCHESTER_TIMER
+#define  SWO_MANCHESTER_TIMER     TIMER3            /* Capture Timer (TM3_EXT on PA.8) */
+#endif
+#ifndef  SWO_MANCHESTER_CLOCK
+#define  SWO_MANCHESTER_CLOCK     __HIRC            /* Capture Timer Clock */
+#endif
+#ifndef  SWO_MANCHESTER_PDMA_CH
+#define  SWO_MANCHESTER_PDMA_CH   1U                /* PDMA Channel */
+#endif
+#ifndef  SWO_MANCHESTER_PDMA_REQ
+#define  SWO_MANCHESTER_PDMA_REQ  PDMA_TMR3         /* PDMA Request Source */
+#endif
+
+#define  EDGE_BLOCK_SIZE          64U               /* Edges per PDMA descriptor */
+#define  EDGE_BLOCK_COUNT         4U                /* PDMA descriptors in ring (2^n) */
+#define  EDGE_BUFFER_SIZE        (EDGE_BLOCK_SIZE * EDGE_BLOCK_COUNT)
+#define  EDGE_TIME_MASK           TIMER_CMP_MAX_VALUE
+
+// Manchester decoder states
+#define  MANCHESTER_IDLE          0U    /* Line idle, next edge starts a packet */
+#define  MANCHESTER_START         1U    /* Start bit rising edge seen */
+#define  MANCHESTER_MID           2U    /* At a mid-bit transition */
+#define  MANCHESTER_EDGE          3U    /* At a bit boundary transition */
+#define  MANCHESTER_SYNC          4U    /* Lost sync, wait for idle gap */
+
+static uint8_t           Manchester_Ready = 0U;
+static uint32_t          Manchester_HalfBit;                  /* Expected half bit time (timer ticks) */
+static DSCT_T            EdgeDesc[EDGE_BLOCK_COUNT];          /* PDMA descriptor ring */
+static uint32_t          EdgeBuf[EDGE_BUFFER_SIZE];           /* Captured edge times */
+static volatile uint32_t EdgeBlocks;                          /* Completed PDMA descriptors */
+static uint32_t          EdgeIndex;                           /* Next edge to decode */
+
+// Manchester decoder state
+static struct {
+  uint32_t time;        /* Time of last edge */
+  uint32_t half;        /* Recovered half bit time */
+  uint8_t  state;       /* Decoder state */
+  uint8_t  bit;         /* Value of last decoded bit */
+  uint8_t  data;        /* Byte being assembled */
+  uint8_t  count;       /* Number of bits in data */
+} Manchester;
+
+#endif  /* (SWO_MANCHESTER != 0) */
+
 
 #if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
 
 
 #define SWO_STREAM_TIMEOUT      50U     /* Stream timeout in ms */
 
-#define USB_BLOCK_SIZE          512U    /* USB Block Size */
+#define USB_BLOCK_SIZE          64U     /* USB Block Size (Full-Speed Bulk packet) */
 #define TRACE_BLOCK_SIZE        64U     /* Trace Block Size (2^n: 32...512) */
 
 // Trace State
 static uint8_t  TraceTransport =  0U;       /* Trace Transport */
 static uint8_t  TraceMode      =  0U;       /* Trace Mode */
 static uint8_t  TraceStatus    =  0U;       /* Trace Status without Errors */
+static uint32_t TraceBaudrate  =  0U;       /* Trace Baudrate (actual) */
 static uint8_t  TraceError[2]  = {0U, 0U};  /* Trace Error flags (banked) */
 static uint8_t  TraceError_n   =  0U;       /* Active Trace Error bank */
 
@@ -95,129 +170,636 @@ static uint8_t  GetTraceStatus (void);
 static void     SetTraceError  (uint8_t flag);
 
 #if (SWO_STREAM != 0)
-extern osThreadId_t      SWO_ThreadId;
+// USB frame counter (1ms, 11-bit) used as stream timebase
+#define SWO_STREAM_TICK()       (USBD->FN & USBD_FN_FN_Msk)
+#define SWO_STREAM_TICK_MASK    (USBD_FN_FN_Msk >> USBD_FN_FN_Pos)
+
+static volatile uint8_t  StreamSignal = 0U; /* Stream Transfer Request */
+static          uint32_t StreamTick;        /* Stream Timeout Reference */
 static volatile uint8_t  TransferBusy = 0U; /* Transfer Busy Flag */
 static          uint32_t TransferSize;      /* Current Transfer Size */
 #endif
 
+// ITM/DWT Packet Filter configuration (SWO_Filter)
+#define TRACE_FILTER_ENABLE     (1U<<0)     /* Filter enabled */
+#define TRACE_FILTER_TIMESTAMP  (1U<<1)     /* Forward local/global timestamp packets */
+#define TRACE_FILTER_EXTENSION  (1U<<2)     /* Forward extension packets */
+#define TRACE_FILTER_SYNC       (1U<<3)     /* Forward synchronization/overflow packets */
+#define TRACE_FILTER_COMPRESS   (1U<<4)     /* Compress forwarded packets */
+
+static struct {
+  uint32_t itm_mask;    /* Forwarded ITM stimulus ports */
+  uint32_t dwt_mask;    /* Forwarded DWT packet discriminator IDs */
+  uint8_t  flags;       /* Filter flags */
+} TraceFilter;
+
+// ITM/DWT packet parser state
+static struct {
+  uint8_t  buf[7];      /* Packet (header and payload) */
+  uint8_t  len;         /* Collected bytes */
+  uint8_t  size;        /* Packet size (0: terminated by continuation bit) */
+  uint8_t  max;         /* Maximum packet size */
+  uint8_t  pass;        /* Forward packet */
+  uint8_t  zeros;       /* Consecutive zero bytes (synchronization) */
+} TracePacket;
+
+// Trace compression (TRACE_FILTER_COMPRESS), see Host/swo_decode.c for the format.
+// Compressed packets use headers which are reserved by the ITM protocol.
+#define TRACE_PC_DELTA          0x04U       /* PC sample as varint of zigzag half-word delta */
+#define TRACE_REPEAT            0x14U       /* Previous packet repeated varint times */
+#define TRACE_PC_SAMPLE         0x17U       /* DWT periodic PC sample header (4-byte payload) */
+#define TRACE_REPEAT_MAX        0x3FFFU     /* Maximum run length (2-byte varint) */
+#define TRACE_DELTA_MAX         0x1FFFFFU   /* Maximum encoded delta (3-byte varint) */
+
+static struct {
+  uint8_t  last[7];     /* Previous packet */
+  uint8_t  len;         /* Previous packet size (0: none) */
+  uint8_t  pc_valid;    /* Previous PC sample valid */
+  uint32_t pc;          /* Previous PC sample */
+  uint32_t repeat;      /* Pending repeat count */
+} TraceCompress;
 
 #if (SWO_UART != 0)
+#define RAW_BUFFER_SIZE         256U        /* Raw UART capture buffer for filtering (2^n) */
 
-// USART Driver Callback function
-//   event: event mask
-static void USART_Callback (uint32_t event) {
+static uint8_t           RawBuf[RAW_BUFFER_SIZE];
+static volatile uint32_t RawIndexI;         /* Received raw data index */
+static          uint32_t RawIndexO;         /* Parsed raw data index */
+#endif
+
+
+// Store trace data into the Trace Buffer (software capture paths)
+//   data: pointer to trace data
+//   num:  number of bytes
+//   return: 1 - stored, 0 - dropped
+static uint32_t Trace_Write (const uint8_t *data, uint32_t num) {
+  uint32_t index_i;
+
+  if (TraceStatus != DAP_SWO_CAPTURE_ACTIVE) {
+    return (0U);
+  }
+  index_i = TraceIndexI;
+  if ((index_i - TraceIndexO) > (SWO_BUFFER_SIZE - num)) {
+    TraceStatus = DAP_SWO_CAPTURE_ACTIVE | DAP_SWO_CAPTURE_PAUSED;
+    return (0U);
+  }
+  while (num--) {
+    TraceBuf[index_i++ & (SWO_BUFFER_SIZE - 1U)] = *data++;
+  }
+  TraceIndexI = index_i;
+  return (1U);
+}
+
+// Publish trace data stored by Trace_Write (timestamp and stream request)
+static void Trace_Commit (void) {
+#if (TIMESTAMP_CLOCK != 0U) 
+  TraceTimestamp.tick  = TIMESTAMP_GET();
+  TraceTimestamp.index = TraceIndexI;
+#endif
+  TraceUpdate = 1U;
+#if (SWO_STREAM != 0)
+  if (TraceTransport == 2U) {
+    if ((TraceIndexI - TraceIndexO) >= (USB_BLOCK_SIZE - (TraceIndexO & (USB_BLOCK_SIZE - 1U)))) {
+      StreamSignal = 1U;
+    }
+  }
+#endif
+}
+
+// Encode unsigned varint (7 bits per byte, LSB group first)
+//   buf:   pointer to output buffer
+//   value: value to encode
+//   return: number of bytes
+static uint32_t Trace_Varint (uint8_t *buf, uint32_t value) {
+  uint32_t n = 0U;
+
+  while (value >= 0x80U) {
+    buf[n++] = (uint8_t)(value | 0x80U);
+    value >>= 7;
+  }
+  buf[n++] = (uint8_t)value;
+  return (n);
+}
+
+// Store compressed trace data, decoder references are invalidated when dropped
+static void Trace_CompressWrite (const uint8_t *data, uint32_t num) {
+  if (Trace_Write(data, num) == 0U) {
+    TraceCompress.len      = 0U;
+    TraceCompress.pc_valid = 0U;
+  }
+}
+
+// Store pending repeat count
+static void Trace_FlushRepeat (void) {
+  uint8_t  buf[4];
+  uint32_t num;
+
+  if (TraceCompress.repeat != 0U) {
+    buf[0] = TRACE_REPEAT;
+    num = 1U + Trace_Varint(&buf[1], TraceCompress.repeat);
+    TraceCompress.repeat = 0U;
+    Trace_CompressWrite(buf, num);
+  }
+}
+
+// Reset trace compression state
+static void Trace_ResetCompress (void) {
+  TraceCompress.len      = 0U;
+  TraceCompress.pc_valid = 0U;
+  TraceCompress.repeat   = 0U;
+}
+
+// Store forwarded packet (compressed when enabled)
+//   data: pointer to packet
+//   num:  packet size
+static void Trace_Packet (const uint8_t *data, uint32_t num) {
+  uint8_t  buf[4];
+  uint32_t pc;
+  uint32_t code;
+  int32_t  delta;
+
+  if ((TraceFilter.flags & TRACE_FILTER_COMPRESS) == 0U) {
+    Trace_Write(data, num);
+    return;
+  }
+
+  // Run-length encode repeated packets
+  if ((num == TraceCompress.len) && (memcmp(data, TraceCompress.last, num) == 0)) {
+    if (++TraceCompress.repeat == TRACE_REPEAT_MAX) {
+      Trace_FlushRepeat();
+    }
+    return;
+  }
+  Trace_FlushRepeat();
+
+  memcpy(TraceCompress.last, data, num);
+  TraceCompress.len = (uint8_t)num;
+
+  if ((*data == TRACE_PC_SAMPLE) && (num == 5U)) {
+    pc = (uint32_t)(*(data+1) <<  0) |
+         (uint32_t)(*(data+2) <<  8) |
+         (uint32_t)(*(data+3) << 16) |
+         (uint32_t)(*(data+4) << 24);
+    if ((TraceCompress.pc_valid != 0U) && (((pc | TraceCompress.pc) & 1U) == 0U)) {
+      delta = (int32_t)(pc - TraceCompress.pc) / 2;
+      code  = (delta < 0) ? ~((uint32_t)delta << 1) : ((uint32_t)delta << 1);
+      if (code <= TRACE_DELTA_MAX) {
+        buf[0] = TRACE_PC_DELTA;
+        num = 1U + Trace_Varint(&buf[1], code);
+        data = buf;
+      }
+    }
+    TraceCompress.pc       = pc;
+    TraceCompress.pc_valid = 1U;
+  }
+  Trace_CompressWrite(data, num);
+}
+
+// Store synchronization/overflow byte (keeps packet order with pending repeats)
+static void Trace_Sync (uint8_t data) {
+  Trace_FlushRepeat();
+  Trace_Write(&data, 1U);
+}
+
+// Flush pending compressed data
+//   idle: flush only when all stored trace data has been read
+static void Trace_Flush (uint32_t idle) {
+  if (TraceCompress.repeat == 0U) {
+    return;
+  }
+  if (idle && (TraceIndexI != TraceIndexO)) {
+    return;
+  }
+  Trace_FlushRepeat();
+  Trace_Commit();
+}
+
+// Parse ITM/DWT packet byte and forward packets selected by TraceFilter
+//   data: trace byte
+static void Trace_FilterByte (uint8_t data) {
+  uint32_t hdr;
+
+  if (TracePacket.len == 0U) {
+    // Header
+    if (data == 0x00U) {
+      TracePacket.zeros++;
+      if (TraceFilter.flags & TRACE_FILTER_SYNC) {
+        Trace_Sync(data);
+      }
+      return;
+    }
+    if ((data == 0x80U) && (TracePacket.zeros != 0U)) {
+      // End of synchronization packet
+      TracePacket.zeros = 0U;
+      if (TraceFilter.flags & TRACE_FILTER_SYNC) {
+        Trace_Sync(data);
+      }
+      return;
+    }
+    TracePacket.zeros = 0U;
+
+    hdr = data;
+    TracePacket.size = 0U;
+    TracePacket.max  = 5U;
+    if (hdr == 0x70U) {
+      // Overflow
+      if (TraceFilter.flags & TRACE_FILTER_SYNC) {
+        Trace_Sync(data);
+      }
+      return;
+    } else if ((hdr & 0x03U) != 0U) {
+      // Source packet: instrumentation (ITM) or hardware (DWT)
+      TracePacket.size = (uint8_t)(1U + (1U << ((hdr & 0x03U) - 1U)));
+      if (hdr & 0x04U) {
+        TracePacket.pass = (TraceFilter.dwt_mask >> (hdr >> 3)) & 1U;
+      } else {
+        TracePacket.pass = (TraceFilter.itm_mask >> (hdr >> 3)) & 1U;
+      }
+    } else if ((hdr & 0x0FU) == 0x00U) {
+      // Local timestamp
+      if ((hdr & 0x80U) == 0U) {
+        TracePacket.size = 1U;
+      }
+      TracePacket.pass = (TraceFilter.flags & TRACE_FILTER_TIMESTAMP) ? 1U : 0U;
+    } else if ((hdr == 0x94U) || (hdr == 0xB4U)) {
+      // Global timestamp
+      TracePacket.max  = (hdr == 0xB4U) ? 7U : 5U;
+      TracePacket.pass = (TraceFilter.flags & TRACE_FILTER_TIMESTAMP) ? 1U : 0U;
+    } else if ((hdr & 0x0BU) == 0x08U) {
+      // Extension
+      if ((hdr & 0x80U) == 0U) {
+        TracePacket.size = 1U;
+      }
+      TracePacket.pass = (TraceFilter.flags & TRACE_FILTER_EXTENSION) ? 1U : 0U;
+    } else {
+      // Reserved
+      return;
+    }
+    TracePacket.buf[0] = data;
+    TracePacket.len    = 1U;
+    if (TracePacket.size != 1U) {
+      return;
+    }
+  } else {
+    // Payload
+    TracePacket.buf[TracePacket.len++] = data;
+    if (TracePacket.size == 0U) {
+      if ((data & 0x80U) && (TracePacket.len < TracePacket.max)) {
+        return;
+      }
+    } else if (TracePacket.len < TracePacket.size) {
+      return;
+    }
+  }
+
+  if (TracePacket.pass) {
+    Trace_Packet(TracePacket.buf, TracePacket.len);
+  }
+  TracePacket.len = 0U;
+}
+
+// Process captured trace byte: filter or store directly
+//   data: trace byte
+static void Trace_Input (uint8_t data) {
+  if (TraceFilter.flags & TRACE_FILTER_ENABLE) {
+    Trace_FilterByte(data);
+  } else {
+    Trace_Write(&data, 1U);
+  }
+}
+
+
+#if (SWO_UART != 0)
+
+// Start UART reception of a trace block through PDMA
+//   buf: pointer to buffer for capturing
+//   num: number of bytes to capture
+static void USART_Receive (uint8_t *buf, uint32_t num) {
+  USART_RxNum  = num;
+  USART_RxBusy = 1U;
+  PDMA_SetTransferCnt (PDMA, SWO_UART_PDMA_CH, PDMA_WIDTH_8, num);
+  PDMA_SetTransferAddr(PDMA, SWO_UART_PDMA_CH,
+                       (uint32_t)&SWO_UART_PORT->DAT, PDMA_SAR_FIX,
+                       (uint32_t)buf,                 PDMA_DAR_INC);
+  PDMA_SetTransferMode(PDMA, SWO_UART_PDMA_CH, SWO_UART_PDMA_REQ, 0U, 0U);
+}
+
+// Get number of bytes received by the active PDMA transfer
+//   return: number of bytes received
+static uint32_t USART_GetRxCount (void) {
+  uint32_t ctl;
+
+  ctl = PDMA->DSCT[SWO_UART_PDMA_CH].CTL;
+  if ((ctl & PDMA_DSCT_CTL_OPMODE_Msk) == 0U) {
+    return (USART_RxNum);
+  }
+  return (USART_RxNum - 1U - ((ctl & PDMA_DSCT_CTL_TXCNT_Msk) >> PDMA_DSCT_CTL_TXCNT_Pos));
+}
+
+// Abort the active PDMA reception
+static void USART_AbortReceive (void) {
+  PDMA_STOP(PDMA, SWO_UART_PDMA_CH);
+  PDMA_CLR_TD_FLAG(PDMA, 1U << SWO_UART_PDMA_CH);
+  USART_RxBusy = 0U;
+}
+
+// Enable or disable UART receiver
+//   enable: enable flag
+static void USART_ControlRx (uint32_t enable) {
+  if (enable != 0U) {
+    SWO_UART_PORT->FIFOSTS = UART_FIFOSTS_RXOVIF_Msk | UART_FIFOSTS_BIF_Msk |
+                             UART_FIFOSTS_FEF_Msk    | UART_FIFOSTS_PEF_Msk;
+    SWO_UART_PORT->FUNCSEL &= ~UART_FUNCSEL_TXRXDIS_Msk;
+  } else {
+    SWO_UART_PORT->FUNCSEL |=  UART_FUNCSEL_TXRXDIS_Msk;
+  }
+}
+
+// UART receive complete (PDMA transfer done)
+static void USART_ReceiveComplete (void) {
   uint32_t index_i;
   uint32_t index_o;
   uint32_t count;
   uint32_t num;
 
-  if (event &  ARM_USART_EVENT_RECEIVE_COMPLETE) {
+  if (TraceFilter.flags & TRACE_FILTER_ENABLE) {
+    // Raw data is parsed by Trace_FilterProcess, discard block on overflow
+    index_i = RawIndexI + TraceBlockSize;
+    num = TRACE_BLOCK_SIZE - (index_i & (TRACE_BLOCK_SIZE - 1U));
+    if ((index_i - RawIndexO) <= (RAW_BUFFER_SIZE - num)) {
+      RawIndexI = index_i;
+    } else {
+      SetTraceError(DAP_SWO_BUFFER_OVERRUN);
+      index_i = RawIndexI;
+      num = TRACE_BLOCK_SIZE - (index_i & (TRACE_BLOCK_SIZE - 1U));
+    }
+    TraceBlockSize = num;
+    USART_Receive(&RawBuf[index_i & (RAW_BUFFER_SIZE - 1U)], num);
+    return;
+  }
+
 #if (TIMESTAMP_CLOCK != 0U) 
-    TraceTimestamp.tick = TIMESTAMP_GET();
+  TraceTimestamp.tick = TIMESTAMP_GET();
 #endif
-    index_o  = TraceIndexO;
-    index_i  = TraceIndexI;
-    index_i += TraceBlockSize;
-    TraceIndexI = index_i;
+  index_o  = TraceIndexO;
+  index_i  = TraceIndexI;
+  index_i += TraceBlockSize;
+  TraceIndexI = index_i;
 #if (TIMESTAMP_CLOCK != 0U) 
-    TraceTimestamp.index = index_i;
+  TraceTimestamp.index = index_i;
 #endif
-    num   = TRACE_BLOCK_SIZE - (index_i & (TRACE_BLOCK_SIZE - 1U));
-    count = index_i - index_o;
-    if (count <= (SWO_BUFFER_SIZE - num)) {
-      index_i &= SWO_BUFFER_SIZE - 1U;
-      TraceBlockSize = num;
-      pUSART->Receive(&TraceBuf[index_i], num);
-    } else {
-      TraceStatus = DAP_SWO_CAPTURE_ACTIVE | DAP_SWO_CAPTURE_PAUSED;
-    }
-    TraceUpdate = 1U;
+  num   = TRACE_BLOCK_SIZE - (index_i & (TRACE_BLOCK_SIZE - 1U));
+  count = index_i - index_o;
+  if (count <= (SWO_BUFFER_SIZE - num)) {
+    index_i &= SWO_BUFFER_SIZE - 1U;
+    TraceBlockSize = num;
+    USART_Receive(&TraceBuf[index_i], num);
+  } else {
+    TraceStatus = DAP_SWO_CAPTURE_ACTIVE | DAP_SWO_CAPTURE_PAUSED;
+  }
+  TraceUpdate = 1U;
 #if (SWO_STREAM != 0)
-    if (TraceTransport == 2U) {
-      if (count >= (USB_BLOCK_SIZE - (index_o & (USB_BLOCK_SIZE - 1U)))) {
-        osThreadFlagsSet(SWO_ThreadId, 1U);
-      }
+  if (TraceTransport == 2U) {
+    if (count >= (USB_BLOCK_SIZE - (index_o & (USB_BLOCK_SIZE - 1U)))) {
+      StreamSignal = 1U;
     }
+  }
 #endif
+}
+
+// Stop UART reception and account the partially received block
+static void USART_StopReceive (void) {
+  uint32_t count;
+
+  if (USART_RxBusy) {
+    count = USART_GetRxCount();
+    USART_AbortReceive();
+    if (TraceFilter.flags & TRACE_FILTER_ENABLE) {
+      RawIndexI += count;
+    } else {
+      TraceIndexI += count;
+    }
+  }
+}
+
+// Restart UART reception at the current capture index
+static void USART_RestartReceive (void) {
+  uint32_t index;
+  uint32_t num;
+
+  if (TraceFilter.flags & TRACE_FILTER_ENABLE) {
+    index = RawIndexI;
+    num = TRACE_BLOCK_SIZE - (index & (TRACE_BLOCK_SIZE - 1U));
+    TraceBlockSize = num;
+    USART_Receive(&RawBuf[index & (RAW_BUFFER_SIZE - 1U)], num);
+  } else if ((TraceStatus & DAP_SWO_CAPTURE_PAUSED) == 0U) {
+    index = TraceIndexI & (SWO_BUFFER_SIZE - 1U);
+    num = TRACE_BLOCK_SIZE - (index & (TRACE_BLOCK_SIZE - 1U));
+    TraceBlockSize = num;
+    USART_Receive(&TraceBuf[index], num);
+  }
+}
+
+// Parse raw UART data through the packet filter (called from main loop)
+static void Trace_FilterProcess (void) {
+  uint32_t index_i;
+  uint32_t index_o;
+  uint32_t count;
+
+  // Include bytes of the block currently being received
+  do {
+    index_i = RawIndexI;
+    count   = USART_RxBusy ? USART_GetRxCount() : 0U;
+  } while (index_i != RawIndexI);
+  index_i += count;
+
+  index_o = RawIndexO;
+  if (index_o == index_i) {
+    return;
+  }
+  count = TraceIndexI;
+  while (index_o != index_i) {
+    Trace_FilterByte(RawBuf[index_o++ & (RAW_BUFFER_SIZE - 1U)]);
   }
-  if (event &  ARM_USART_EVENT_RX_OVERFLOW) {
+  RawIndexO = index_o;
+  if (TraceIndexI != count) {
+    Trace_Commit();
+  }
+}
+
+// UART Interrupt Handler (receive line status and buffer errors)
+void SWO_UART_IRQHandler (void) {
+  uint32_t status;
+
+  status = SWO_UART_PORT->FIFOSTS;
+  if (status & UART_FIFOSTS_RXOVIF_Msk) {
     SetTraceError(DAP_SWO_BUFFER_OVERRUN);
   }
-  if (event & (ARM_USART_EVENT_RX_BREAK         |
-               ARM_USART_EVENT_RX_FRAMING_ERROR |
-               ARM_USART_EVENT_RX_PARITY_ERROR)) {
+  if (status & (UART_FIFOSTS_BIF_Msk | UART_FIFOSTS_FEF_Msk | UART_FIFOSTS_PEF_Msk)) {
     SetTraceError(DAP_SWO_STREAM_ERROR);
   }
+  SWO_UART_PORT->FIFOSTS = status & (UART_FIFOSTS_RXOVIF_Msk | UART_FIFOSTS_BIF_Msk |
+                                     UART_FIFOSTS_FEF_Msk    | UART_FIFOSTS_PEF_Msk);
 }
 
 // Enable or disable UART SWO Mode
 //   enable: enable flag
 //   return: 1 - Success, 0 - Error
 __WEAK uint32_t UART_SWO_Mode (uint32_t enable) {
-  int32_t status;
 
   USART_Ready = 0U;
 
   if (enable != 0U) {
-    status = pUSART->Initialize(USART_Callback);
-    if (status != ARM_DRIVER_OK) {
-      return (0U);
-    }
-    status = pUSART->PowerControl(ARM_POWER_FULL);
-    if (status != ARM_DRIVER_OK) {
-      pUSART->Uninitialize();
-      return (0U);
-    }
+    SYS->GPA_MFPH = (SYS->GPA_MFPH & ~SYS_GPA_MFPH_PA8MFP_Msk) | SYS_GPA_MFPH_PA8MFP_UART1_RXD;
+    SWO_UART_PORT->FUNCSEL = UART_FUNCSEL_UART | UART_FUNCSEL_TXRXDIS_Msk;
+    SWO_UART_PORT->LINE    = UART_WORD_LEN_8 | UART_PARITY_NONE | UART_STOP_BIT_1;
+    SWO_UART_PORT->FIFO   |= UART_FIFO_RXRST_Msk;
+    SWO_UART_PORT->INTEN   = UART_INTEN_RXPDMAEN_Msk | UART_INTEN_RLSIEN_Msk | UART_INTEN_BUFERRIEN_Msk;
+
+    PDMA_Open(PDMA, 1U << SWO_UART_PDMA_CH);
+    PDMA_SetBurstType(PDMA, SWO_UART_PDMA_CH, PDMA_REQ_SINGLE, 0U);
+    PDMA_EnableInt(PDMA, SWO_UART_PDMA_CH, PDMA_INT_TRANS_DONE);
+
+    NVIC_EnableIRQ(PDMA_IRQn);
+    NVIC_EnableIRQ(SWO_UART_IRQn);
   } else {
-    pUSART->Control(ARM_USART_CONTROL_RX, 0U);
-    pUSART->Control(ARM_USART_ABORT_RECEIVE, 0U);
-    pUSART->PowerControl(ARM_POWER_OFF);
-    pUSART->Uninitialize();
+    USART_ControlRx(0U);
+    USART_AbortReceive();
+    SWO_UART_PORT->INTEN = 0U;
+    PDMA_DisableInt(PDMA, SWO_UART_PDMA_CH, PDMA_INT_TRANS_DONE);
+    PDMA->CHCTL &= ~(1U << SWO_UART_PDMA_CH);
+    NVIC_DisableIRQ(SWO_UART_IRQn);
+    SYS->GPA_MFPH = (SYS->GPA_MFPH & ~SYS_GPA_MFPH_PA8MFP_Msk);
   }
   return (1U);
 }
 
+#if (SWO_UART_AUTOBAUD != 0)
+// Detect UART baudrate from the pulse widths on the SWO pin
+//   return: detected baudrate or 0 when no trace activity
+static uint32_t USART_AutoBaud (void) {
+  uint32_t mfp;
+  uint32_t cnt, last, elapsed;
+  uint32_t time, prev;
+  uint32_t width, min;
+  uint32_t num, n, k;
+  uint32_t bits, sum;
+
+  // Route SWO pin to the timer capture input while measuring
+  mfp = SYS->GPA_MFPH;
+  SYS->GPA_MFPH = (mfp & ~SYS_GPA_MFPH_PA8MFP_Msk) | SYS_GPA_MFPH_PA8MFP_TM3_EXT;
+
+  SWO_AUTOBAUD_TIMER->CTL = TIMER_CONTINUOUS_MODE;
+  SWO_AUTOBAUD_TIMER->CMP = TIMER_CMP_MAX_VALUE;
+  TIMER_CaptureSelect(SWO_AUTOBAUD_TIMER, TIMER_CAPTURE_FROM_EXTERNAL);
+  SWO_AUTOBAUD_TIMER->EXTCTL  = TIMER_CAPTURE_FREE_COUNTING_MODE |
+                                TIMER_CAPTURE_FALLING_AND_RISING_EDGE;
+  SWO_AUTOBAUD_TIMER->EINTSTS = TIMER_EINTSTS_CAPIF_Msk;
+  TIMER_StartCapture(SWO_AUTOBAUD_TIMER);
+  TIMER_Start(SWO_AUTOBAUD_TIMER);
+
+  // Collect widths between consecutive edges (missed edges only lengthen a pulse)
+  num     = 0U;
+  min     = 0xFFFFU;
+  prev    = 0U;
+  elapsed = 0U;
+  n       = 0U;
+  last    = SWO_AUTOBAUD_TIMER->CNT;
+  while ((num < AUTOBAUD_PULSES) && (elapsed < AUTOBAUD_TIMEOUT)) {
+    if (SWO_AUTOBAUD_TIMER->EINTSTS & TIMER_EINTSTS_CAPIF_Msk) {
+      SWO_AUTOBAUD_TIMER->EINTSTS = TIMER_EINTSTS_CAPIF_Msk;
+      time = SWO_AUTOBAUD_TIMER->CAP;
+      if (n != 0U) {
+        width = (time - prev) & TIMER_CMP_MAX_VALUE;
+        if (width > 0xFFFFU) {
+          width = 0xFFFFU;
+        }
+        if (width >= AUTOBAUD_WIDTH_MIN) {
+          AutoBaudPulse[num++] = (uint16_t)width;
+          if (width < min) {
+            min = width;
+          }
+        }
+      }
+      prev = time;
+      n    = 1U;
+    }
+    cnt = SWO_AUTOBAUD_TIMER->CNT;
+    elapsed += (cnt - last) & TIMER_CMP_MAX_VALUE;
+    last = cnt;
+  }
+
+  TIMER_StopCapture(SWO_AUTOBAUD_TIMER);
+  TIMER_Stop(SWO_AUTOBAUD_TIMER);
+  SYS->GPA_MFPH = mfp;
+
+  if (num < AUTOBAUD_PULSES_MIN) {
+    return (0U);
+  }
+
+  // Shortest pulse is one bit, refine with all pulses of up to one frame (10 bits)
+  bits = 0U;
+  sum  = 0U;
+  for (n = 0U; n < num; n++) {
+    k = (AutoBaudPulse[n] + (min / 2U)) / min;
+    if (k <= 10U) {
+      bits += k;
+      sum  += AutoBaudPulse[n];
+    }
+  }
+  // Bit time in 1/16 timer ticks
+  sum = ((sum * 16U) + (bits / 2U)) / bits;
+
+  return ((SWO_AUTOBAUD_CLOCK * 16U) / sum);
+}
+#endif
+
 // Configure UART SWO Baudrate
-//   baudrate: requested baudrate
+//   baudrate: requested baudrate (0 = auto detect when SWO_UART_AUTOBAUD)
 //   return:   actual baudrate or 0 when not configured
 __WEAK uint32_t UART_SWO_Baudrate (uint32_t baudrate) {
-  int32_t  status;
-  uint32_t index;
-  uint32_t num;
+  uint32_t divider;
 
   if (baudrate > SWO_UART_MAX_BAUDRATE) {
     baudrate = SWO_UART_MAX_BAUDRATE;
   }
+#if (SWO_UART_AUTOBAUD == 0)
+  if (baudrate == 0U) {
+    USART_Ready = 0U;
+    return (0U);
+  }
+#endif
 
   if (TraceStatus & DAP_SWO_CAPTURE_ACTIVE) {
-    pUSART->Control(ARM_USART_CONTROL_RX, 0U);
-    if (pUSART->GetStatus().rx_busy) {
-      TraceIndexI += pUSART->GetRxCount();
-      pUSART->Control(ARM_USART_ABORT_RECEIVE, 0U);
-    }
+    USART_ControlRx(0U);
+    USART_StopReceive();
   }
 
-  status = pUSART->Control(ARM_USART_MODE_ASYNCHRONOUS |
-                           ARM_USART_DATA_BITS_8       |
-                           ARM_USART_PARITY_NONE       |
-                           ARM_USART_STOP_BITS_1,
-                           baudrate);
+#if (SWO_UART_AUTOBAUD != 0)
+  if (baudrate == 0U) {
+    baudrate = USART_AutoBaud();
+    if (baudrate > SWO_UART_MAX_BAUDRATE) {
+      baudrate = SWO_UART_MAX_BAUDRATE;
+    }
+    if (baudrate == 0U) {
+      USART_Ready = 0U;
+      return (0U);
+    }
+  }
+#endif
 
-  if (status == ARM_DRIVER_OK) {
-    USART_Ready = 1U;
-  } else {
-    USART_Ready = 0U;
-    return (0U);
+  divider = UART_BAUD_MODE2_DIVIDER(SWO_UART_CLOCK, baudrate);
+  if (divider > 0xFFFFU) {
+    divider = 0xFFFFU;
   }
+  SWO_UART_PORT->BAUD = UART_BAUD_MODE2 | divider;
+  baudrate = SWO_UART_CLOCK / (divider + 2U);
+
+  USART_Ready = 1U;
 
   if (TraceStatus & DAP_SWO_CAPTURE_ACTIVE) {
-    if ((TraceStatus & DAP_SWO_CAPTURE_PAUSED) == 0U) {
-      index = TraceIndexI & (SWO_BUFFER_SIZE - 1U);
-      num = TRACE_BLOCK_SIZE - (index & (TRACE_BLOCK_SIZE - 1U));
-      TraceBlockSize = num;
-      pUSART->Receive(&TraceBuf[index], num);
-    }
-    pUSART->Control(ARM_USART_CONTROL_RX, 1U);
+    USART_RestartReceive();
+    USART_ControlRx(1U);
   }
 
   return (baudrate);
@@ -227,26 +809,25 @@ __WEAK uint32_t UART_SWO_Baudrate (uint32_t baudrate) {
 //   active: active flag
 //   return: 1 - Success, 0 - Error
 __WEAK uint32_t UART_SWO_Control (uint32_t active) {
-  int32_t status;
 
   if (active) {
     if (!USART_Ready) { 
       return (0U);
     }
     TraceBlockSize = 1U;
-    status = pUSART->Receive(&TraceBuf[0], 1U);
-    if (status != ARM_DRIVER_OK) {
-      return (0U);
-    }
-    status = pUSART->Control(ARM_USART_CONTROL_RX, 1U);
-    if (status != ARM_DRIVER_OK) {
-      return (0U);
+    if (TraceFilter.flags & TRACE_FILTER_ENABLE) {
+      RawIndexI = 0U;
+      RawIndexO = 0U;
+      USART_Receive(&RawBuf[0], 1U);
+    } else {
+      USART_Receive(&TraceBuf[0], 1U);
     }
+    USART_ControlRx(1U);
   } else {
-    pUSART->Control(ARM_USART_CONTROL_RX, 0U);
-    if (pUSART->GetStatus().rx_busy) {
-      TraceIndexI += pUSART->GetRxCount();
-      pUSART->Control(ARM_USART_ABORT_RECEIVE, 0U);
+    USART_ControlRx(0U);
+    USART_StopReceive();
+    if (TraceFilter.flags & TRACE_FILTER_ENABLE) {
+      Trace_FilterProcess();
     }
   }
   return (1U);
@@ -256,8 +837,11 @@ __WEAK uint32_t UART_SWO_Control (uint32_t active) {
 //   buf: pointer to buffer for capturing
 //   num: number of bytes to capture
 __WEAK void UART_SWO_Capture (uint8_t *buf, uint32_t num) {
+  if (TraceFilter.flags & TRACE_FILTER_ENABLE) {
+    return;     // Raw capture is never paused when filtering
+  }
   TraceBlockSize = num;
-  pUSART->Receive(buf, num);
+  USART_Receive(buf, num);
 }
 
 // Get UART SWO Pending Trace Count
@@ -265,8 +849,8 @@ __WEAK void UART_SWO_Capture (uint8_t *buf, uint32_t num) {
 __WEAK uint32_t UART_SWO_GetCount (void) {
   uint32_t count;
 
-  if (pUSART->GetStatus().rx_busy) {
-    count = pUSART->GetRxCount();
+  if (USART_RxBusy && ((TraceFilter.flags & TRACE_FILTER_ENABLE) == 0U)) {
+    count = USART_GetRxCount();
   } else {
     count = 0U;
   }
@@ -278,41 +862,308 @@ __WEAK uint32_t UART_SWO_GetCount (void) {
 
 #if (SWO_MANCHESTER != 0)
 
+// Store a decoded Manchester bit (LSB first)
+//   bit: bit value
+static void Manchester_PutBit (uint32_t bit) {
+  Manchester.bit  = (uint8_t)bit;
+  Manchester.data = (uint8_t)((Manchester.data >> 1) | (bit << 7));
+  if (++Manchester.count == 8U) {
+    Manchester.count = 0U;
+    Trace_Input(Manchester.data);
+  }
+}
+
+// Start of a new Manchester packet (rising edge of start bit)
+//   time: edge time
+static void Manchester_Start (uint32_t time) {
+  Manchester.time  = time;
+  Manchester.state = MANCHESTER_START;
+}
+
+// Decode one captured edge
+//   time: edge time (timer ticks)
+static void Manchester_Edge (uint32_t time) {
+  uint32_t delta;
+  uint32_t half;
+
+  delta = (time - Manchester.time) & EDGE_TIME_MASK;
+  half  = Manchester.half;
+
+  switch (Manchester.state) {
+    case MANCHESTER_IDLE:
+      Manchester_Start(time);
+      return;
+    case MANCHESTER_START:
+      // Start bit is '1': high for half a bit, clock recovered from its width
+      if (((3U * delta) < (2U * Manchester_HalfBit)) ||
+          ((2U * delta) > (3U * Manchester_HalfBit))) {
+        SetTraceError(DAP_SWO_STREAM_ERROR);
+        Manchester.state = MANCHESTER_SYNC;
+        break;
+      }
+      Manchester.half  = delta;
+      Manchester.bit   = 1U;
+      Manchester.data  = 0U;
+      Manchester.count = 0U;
+      Manchester.state = MANCHESTER_MID;
+      break;
+    case MANCHESTER_MID:
+      if ((2U * delta) < (3U * half)) {
+        Manchester.state = MANCHESTER_EDGE;
+      } else if ((2U * delta) < (5U * half)) {
+        Manchester_PutBit(Manchester.bit ^ 1U);
+      } else if (Manchester.bit != 0U) {
+        // Line idle low after a '1': this edge starts the next packet
+        Manchester_Start(time);
+        return;
+      } else {
+        SetTraceError(DAP_SWO_STREAM_ERROR);
+        Manchester.state = MANCHESTER_IDLE;
+      }
+      break;
+    case MANCHESTER_EDGE:
+      if ((2U * delta) < (3U * half)) {
+        Manchester_PutBit(Manchester.bit);
+        Manchester.state = MANCHESTER_MID;
+      } else if (Manchester.bit == 0U) {
+        // Line returned low after a '0': this edge starts the next packet
+        Manchester_Start(time);
+        return;
+      } else {
+        SetTraceError(DAP_SWO_STREAM_ERROR);
+        Manchester.state = MANCHESTER_IDLE;
+      }
+      break;
+    case MANCHESTER_SYNC:
+      if ((2U * delta) >= (5U * Manchester_HalfBit)) {
+        Manchester_Start(time);
+        return;
+      }
+      break;
+    default:
+      break;
+  }
+  Manchester.time = time;
+}
+
+// Get number of edges written by PDMA
+//   return: edge write index
+static uint32_t Manchester_EdgeCount (void) {
+  uint32_t blocks;
+  uint32_t ctl;
+  uint32_t count;
+
+  do {
+    blocks = EdgeBlocks;
+    ctl    = PDMA->DSCT[SWO_MANCHESTER_PDMA_CH].CTL;
+  } while (blocks != EdgeBlocks);
+
+  count = blocks * EDGE_BLOCK_SIZE;
+  if ((ctl & PDMA_DSCT_CTL_OPMODE_Msk) != 0U) {
+    count += EDGE_BLOCK_SIZE - 1U - ((ctl & PDMA_DSCT_CTL_TXCNT_Msk) >> PDMA_DSCT_CTL_TXCNT_Pos);
+  }
+  return (count);
+}
+
+// Decode captured Manchester edges into the Trace Buffer
+static void Manchester_Decode (void) {
+  uint32_t count;
+  uint32_t index;
+  uint32_t index_i;
+
+  count = Manchester_EdgeCount();
+  index = EdgeIndex;
+  if ((int32_t)(count - index) <= 0) {
+    return;
+  }
+  if ((count - index) > (EDGE_BUFFER_SIZE - EDGE_BLOCK_SIZE)) {
+    SetTraceError(DAP_SWO_BUFFER_OVERRUN);
+    Manchester.state = MANCHESTER_SYNC;
+    index = count - 1U;
+    Manchester.time = EdgeBuf[index & (EDGE_BUFFER_SIZE - 1U)];
+    index++;
+  }
+
+  index_i = TraceIndexI;
+  while (index != count) {
+    Manchester_Edge(EdgeBuf[index & (EDGE_BUFFER_SIZE - 1U)]);
+    index++;
+  }
+  EdgeIndex = index;
+
+  if (TraceIndexI != index_i) {
+    Trace_Commit();
+  }
+}
+
+// PDMA descriptor completed (called from PDMA interrupt)
+static void Manchester_BlockComplete (void) {
+  uint32_t n;
+
+  n = EdgeBlocks & (EDGE_BLOCK_COUNT - 1U);
+  EdgeBlocks++;
+
+  // Re-arm the descriptor for the next pass through the ring
+  EdgeDesc[n].CTL = ((EDGE_BLOCK_SIZE - 1U) << PDMA_DSCT_CTL_TXCNT_Pos) |
+                    PDMA_WIDTH_32 | PDMA_SAR_FIX | PDMA_DAR_INC |
+                    PDMA_REQ_SINGLE | PDMA_OP_SCATTER;
+  EdgeDesc[n].DA  = (uint32_t)&EdgeBuf[n * EDGE_BLOCK_SIZE];
+}
+
+// Start edge capture into the PDMA descriptor ring
+static void Manchester_StartCapture (void) {
+  uint32_t n;
+
+  EdgeBlocks = 0U;
+  EdgeIndex  = 0U;
+  Manchester.state = MANCHESTER_IDLE;
+
+  PDMA->SCATBA = (uint32_t)&EdgeDesc[0] & PDMA_SCATBA_SCATBA_Msk;
+  for (n = 0U; n < EDGE_BLOCK_COUNT; n++) {
+    EdgeDesc[n].CTL  = ((EDGE_BLOCK_SIZE - 1U) << PDMA_DSCT_CTL_TXCNT_Pos) |
+                       PDMA_WIDTH_32 | PDMA_SAR_FIX | PDMA_DAR_INC |
+                       PDMA_REQ_SINGLE | PDMA_OP_SCATTER;
+    EdgeDesc[n].SA   = (uint32_t)&SWO_MANCHESTER_TIMER->CAP;
+    EdgeDesc[n].DA   = (uint32_t)&EdgeBuf[n * EDGE_BLOCK_SIZE];
+    EdgeDesc[n].NEXT = ((uint32_t)&EdgeDesc[(n + 1U) & (EDGE_BLOCK_COUNT - 1U)]) - PDMA->SCATBA;
+  }
+  PDMA_CLR_TD_FLAG(PDMA, 1U << SWO_MANCHESTER_PDMA_CH);
+  PDMA_SetTransferMode(PDMA, SWO_MANCHESTER_PDMA_CH, SWO_MANCHESTER_PDMA_REQ, 1U, (uint32_t)&EdgeDesc[0]);
+
+  SWO_MANCHESTER_TIMER->EINTSTS = TIMER_EINTSTS_CAPIF_Msk;
+  TIMER_StartCapture(SWO_MANCHESTER_TIMER);
+  TIMER_Start(SWO_MANCHESTER_TIMER);
+}
+
+// Stop edge capture
+static void Manchester_StopCapture (void) {
+  TIMER_StopCapture(SWO_MANCHESTER_TIMER);
+  TIMER_Stop(SWO_MANCHESTER_TIMER);
+  PDMA_STOP(PDMA, SWO_MANCHESTER_PDMA_CH);
+  PDMA_CLR_TD_FLAG(PDMA, 1U << SWO_MANCHESTER_PDMA_CH);
+}
+
 // Enable or disable Manchester SWO Mode
 //   enable: enable flag
 //   return: 1 - Success, 0 - Error
 __WEAK uint32_t Manchester_SWO_Mode (uint32_t enable) {
-  return (0U);
+
+  Manchester_Ready = 0U;
+
+  if (enable != 0U) {
+    SYS->GPA_MFPH = (SYS->GPA_MFPH & ~SYS_GPA_MFPH_PA8MFP_Msk) | SYS_GPA_MFPH_PA8MFP_TM3_EXT;
+
+    // Free running 24-bit counter at timer clock, capture both edges to PDMA
+    SWO_MANCHESTER_TIMER->CTL = TIMER_CONTINUOUS_MODE;
+    SWO_MANCHESTER_TIMER->CMP = TIMER_CMP_MAX_VALUE;
+    TIMER_CaptureSelect(SWO_MANCHESTER_TIMER, TIMER_CAPTURE_FROM_EXTERNAL);
+    SWO_MANCHESTER_TIMER->EXTCTL = TIMER_CAPTURE_FREE_COUNTING_MODE |
+                                   TIMER_CAPTURE_FALLING_AND_RISING_EDGE;
+    TIMER_SetTriggerSource(SWO_MANCHESTER_TIMER, TIMER_TRGSRC_CAPTURE_EVENT);
+    TIMER_SetTriggerTarget(SWO_MANCHESTER_TIMER, TIMER_TRG_TO_PDMA);
+
+    PDMA_Open(PDMA, 1U << SWO_MANCHESTER_PDMA_CH);
+    PDMA_EnableInt(PDMA, SWO_MANCHESTER_PDMA_CH, PDMA_INT_TRANS_DONE);
+    NVIC_EnableIRQ(PDMA_IRQn);
+  } else {
+    Manchester_StopCapture();
+    TIMER_SetTriggerTarget(SWO_MANCHESTER_TIMER, 0U);
+    PDMA_DisableInt(PDMA, SWO_MANCHESTER_PDMA_CH, PDMA_INT_TRANS_DONE);
+    PDMA->CHCTL &= ~(1U << SWO_MANCHESTER_PDMA_CH);
+    SYS->GPA_MFPH = (SYS->GPA_MFPH & ~SYS_GPA_MFPH_PA8MFP_Msk);
+  }
+  return (1U);
 }
 
 // Configure Manchester SWO Baudrate
 //   baudrate: requested baudrate
 //   return:   actual baudrate or 0 when not configured
 __WEAK uint32_t Manchester_SWO_Baudrate (uint32_t baudrate) {
-  return (0U);
+
+  if (baudrate > SWO_MANCHESTER_MAX_BAUDRATE) {
+    baudrate = SWO_MANCHESTER_MAX_BAUDRATE;
+  }
+  if (baudrate == 0U) {
+    Manchester_Ready = 0U;
+    return (0U);
+  }
+
+  // Nominal half bit time, used to validate the start bit of each packet
+  Manchester_HalfBit = (SWO_MANCHESTER_CLOCK + baudrate) / (2U * baudrate);
+  if (Manchester_HalfBit < 2U) {
+    Manchester_HalfBit = 2U;
+  }
+  Manchester_Ready = 1U;
+
+  return (SWO_MANCHESTER_CLOCK / (2U * Manchester_HalfBit));
 }
 
 // Control Manchester SWO Capture
 //   active: active flag
 //   return: 1 - Success, 0 - Error
 __WEAK uint32_t Manchester_SWO_Control (uint32_t active) {
-  return (0U);
+
+  if (active) {
+    if (!Manchester_Ready) {
+      return (0U);
+    }
+    Manchester_StartCapture();
+  } else {
+    TIMER_StopCapture(SWO_MANCHESTER_TIMER);
+    Manchester_Decode();
+    Manchester_StopCapture();
+  }
+  return (1U);
 }
 
 // Start Manchester SWO Capture
 //   buf: pointer to buffer for capturing
 //   num: number of bytes to capture
 __WEAK void Manchester_SWO_Capture (uint8_t *buf, uint32_t num) {
+  // Edges are captured continuously, decoded bytes go straight to TraceBuf
+  (void)buf;
+  (void)num;
 }
 
 // Get Manchester SWO Pending Trace Count
 //   return: number of pending trace data bytes
 __WEAK uint32_t Manchester_SWO_GetCount (void) {
+  return (0U);
 }
 
 #endif  /* (SWO_MANCHESTER != 0) */
 
 
+// PDMA Interrupt Handler
+void PDMA_IRQHandler (void) {
+  uint32_t status;
+  uint32_t done;
+
+  status = PDMA_GET_INT_STATUS(PDMA);
+  if (status & PDMA_INTSTS_ABTIF_Msk) {
+    PDMA_CLR_ABORT_FLAG(PDMA, PDMA_GET_ABORT_STS(PDMA));
+  }
+  if (status & PDMA_INTSTS_TDIF_Msk) {
+    done = PDMA_GET_TD_STS(PDMA);
+#if (SWO_UART != 0)
+    if (done & (1U << SWO_UART_PDMA_CH)) {
+      PDMA_CLR_TD_FLAG(PDMA, 1U << SWO_UART_PDMA_CH);
+      if (USART_RxBusy != 0U) {
+        USART_RxBusy = 0U;
+        USART_ReceiveComplete();
+      }
+    }
+#endif
+#if (SWO_MANCHESTER != 0)
+    if (done & (1U << SWO_MANCHESTER_PDMA_CH)) {
+      PDMA_CLR_TD_FLAG(PDMA, 1U << SWO_MANCHESTER_PDMA_CH);
+      Manchester_BlockComplete();
+    }
+#endif
+  }
+}
+
+
 // Clear Trace Errors and Data
 static void ClearTrace (void) {
 
@@ -331,6 +1182,10 @@ static void ClearTrace (void) {
   TraceIndexI   = 0U;
   TraceIndexO   = 0U;
 
+  TracePacket.len   = 0U;
+  TracePacket.zeros = 0U;
+  Trace_ResetCompress();
+
 #if (TIMESTAMP_CLOCK != 0U) 
   TraceTimestamp.index = 0U;
   TraceTimestamp.tick  = 0U;
@@ -507,7 +1362,8 @@ uint32_t SWO_Mode (const uint8_t *request, uint8_t *response) {
     TraceMode = DAP_SWO_OFF;
   }
 
-  TraceStatus = 0U;
+  TraceStatus   = 0U;
+  TraceBaudrate = 0U;
 
   if (result != 0U) {
     *response = DAP_OK;
@@ -551,6 +1407,7 @@ uint32_t SWO_Baudrate (const uint8_t *request, uint8_t *response) {
   if (baudrate == 0U) {
     TraceStatus = 0U;
   }
+  TraceBaudrate = baudrate;
 
   *response++ = (uint8_t)(baudrate >>  0);
   *response++ = (uint8_t)(baudrate >>  8);
@@ -591,11 +1448,14 @@ uint32_t SWO_Control (const uint8_t *request, uint8_t *response) {
         result = 0U;
         break;
     }
+    if ((result != 0U) && (active == 0U)) {
+      Trace_Flush(0U);
+    }
     if (result != 0U) {
       TraceStatus = active;
 #if (SWO_STREAM != 0)
       if (TraceTransport == 2U) {
-        osThreadFlagsSet(SWO_ThreadId, 1U);
+        StreamSignal = 1U;
       }
 #endif
     }
@@ -681,14 +1541,52 @@ uint32_t SWO_ExtendedStatus (const uint8_t *request, uint8_t *response) {
     *response++ = (uint8_t)(tick  >>  8);
     *response++ = (uint8_t)(tick  >> 16);
     *response++ = (uint8_t)(tick  >> 24);
-    num += 4U;
+    num += 8U;
   }
 #endif
 
+  if (cmd & 0x08U) {
+    // Vendor extension: actual (or auto detected) baudrate
+    *response++ = (uint8_t)(TraceBaudrate >>  0);
+    *response++ = (uint8_t)(TraceBaudrate >>  8);
+    *response++ = (uint8_t)(TraceBaudrate >> 16);
+    *response++ = (uint8_t)(TraceBaudrate >> 24);
+    num += 4U;
+  }
+
   return ((1U << 16) | num);
 }
 
 
+// Process SWO Filter (vendor) command and prepare response
+//   request:  pointer to request data
+//   response: pointer to response data
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWO_Filter (const uint8_t *request, uint8_t *response) {
+
+  if ((TraceStatus & DAP_SWO_CAPTURE_ACTIVE) == 0U) {
+    TraceFilter.flags    = *request;
+    TraceFilter.itm_mask = (uint32_t)(*(request+1) <<  0) |
+                           (uint32_t)(*(request+2) <<  8) |
+                           (uint32_t)(*(request+3) << 16) |
+                           (uint32_t)(*(request+4) << 24);
+    TraceFilter.dwt_mask = (uint32_t)(*(request+5) <<  0) |
+                           (uint32_t)(*(request+6) <<  8) |
+                           (uint32_t)(*(request+7) << 16) |
+                           (uint32_t)(*(request+8) << 24);
+    TracePacket.len   = 0U;
+    TracePacket.zeros = 0U;
+    Trace_ResetCompress();
+    *response = DAP_OK;
+  } else {
+    *response = DAP_ERROR;
+  }
+
+  return ((9U << 16) | 1U);
+}
+
+
 // Process SWO Data command and prepare response
 //   request:  pointer to request data
 //   response: pointer to response data
@@ -741,54 +1639,66 @@ void SWO_TransferComplete (void) {
   TraceIndexO += TransferSize;
   TransferBusy = 0U;
   ResumeTrace();
-  osThreadFlagsSet(SWO_ThreadId, 1U);
+  StreamSignal = 1U;
+}
+
+// Check if SWO trace uses the streaming endpoint
+//   return: 1 = trace capture or transfer active on the stream, 0 = idle
+uint32_t SWO_StreamActive (void) {
+  if (TraceTransport != 2U) {
+    return (0U);
+  }
+  return (((TraceStatus & DAP_SWO_CAPTURE_ACTIVE) || (TransferBusy != 0U)) ? 1U : 0U);
 }
 
-// SWO Thread
-__NO_RETURN void SWO_Thread (void *argument) {
-  uint32_t timeout;
-  uint32_t flags;
+// SWO Stream Process
+//   Queues trace data to the streaming endpoint: complete USB blocks on
+//   request, any remaining data after SWO_STREAM_TIMEOUT or on capture stop.
+static void SWO_StreamProcess (void) {
+  uint32_t flush;
   uint32_t count;
   uint32_t index;
   uint32_t i, n;
-  (void)   argument;
-
-  timeout = osWaitForever;
 
-  for (;;) {
-    flags = osThreadFlagsWait(1U, osFlagsWaitAny, timeout);
-    if (TraceStatus & DAP_SWO_CAPTURE_ACTIVE) {
-      timeout = SWO_STREAM_TIMEOUT;
-    } else {
-      timeout = osWaitForever;
-      flags   = osFlagsErrorTimeout;
+  if (StreamSignal != 0U) {
+    StreamSignal = 0U;
+    StreamTick   = SWO_STREAM_TICK();
+    flush = ((TraceStatus & DAP_SWO_CAPTURE_ACTIVE) == 0U) ? 1U : 0U;
+  } else if (TraceStatus & DAP_SWO_CAPTURE_ACTIVE) {
+    if (((SWO_STREAM_TICK() - StreamTick) & SWO_STREAM_TICK_MASK) < SWO_STREAM_TIMEOUT) {
+      return;
     }
-    if (TransferBusy == 0U) {
-      count = GetTraceCount();
-      if (count != 0U) {
-        index = TraceIndexO & (SWO_BUFFER_SIZE - 1U);
-        n = SWO_BUFFER_SIZE - index;
-        if (count > n) {
-          count = n;
-        }
-        if (flags != osFlagsErrorTimeout) {
-          i = index & (USB_BLOCK_SIZE - 1U);
-          if (i == 0U) {
-            count &= ~(USB_BLOCK_SIZE - 1U);
+    StreamTick = SWO_STREAM_TICK();
+    flush = 1U;
+  } else {
+    return;
+  }
+
+  if (TransferBusy == 0U) {
+    count = GetTraceCount();
+    if (count != 0U) {
+      index = TraceIndexO & (SWO_BUFFER_SIZE - 1U);
+      n = SWO_BUFFER_SIZE - index;
+      if (count > n) {
+        count = n;
+      }
+      if (flush == 0U) {
+        i = index & (USB_BLOCK_SIZE - 1U);
+        if (i == 0U) {
+          count &= ~(USB_BLOCK_SIZE - 1U);
+        } else {
+          n = USB_BLOCK_SIZE - i;
+          if (count >= n) {
+            count = n;
           } else {
-            n = USB_BLOCK_SIZE - i;
-            if (count >= n) {
-              count = n;
-            } else {
-              count = 0U;
-            }
+            count = 0U;
           }
         }
-        if (count != 0U) {
-          TransferSize = count;
-          TransferBusy = 1U;
-          SWO_QueueTransfer(&TraceBuf[index], count);
-        }
+      }
+      if (count != 0U) {
+        TransferSize = count;
+        TransferBusy = 1U;
+        SWO_QueueTransfer(&TraceBuf[index], count);
       }
     }
   }
@@ -797,4 +1707,26 @@ __NO_RETURN void SWO_Thread (void *argument) {
 #endif  /* (SWO_STREAM != 0) */
 
 
+// SWO Process (called periodically from the main loop)
+void SWO_Process (void) {
+#if (SWO_UART != 0)
+  if ((TraceMode == DAP_SWO_UART) && (TraceStatus & DAP_SWO_CAPTURE_ACTIVE) &&
+      (TraceFilter.flags & TRACE_FILTER_ENABLE)) {
+    Trace_FilterProcess();
+  }
+#endif
+#if (SWO_MANCHESTER != 0)
+  if ((TraceMode == DAP_SWO_MANCHESTER) && (TraceStatus & DAP_SWO_CAPTURE_ACTIVE)) {
+    Manchester_Decode();
+  }
+#endif
+  if (TraceStatus == DAP_SWO_CAPTURE_ACTIVE) {
+    Trace_Flush(1U);    // Pending run once the host has caught up
+  }
+#if (SWO_STREAM != 0)
+  SWO_StreamProcess();
+#endif
+}
+
+
 #endif  /* ((SWO_UART != 0) || (SWO_MANCHESTER != 0)) */
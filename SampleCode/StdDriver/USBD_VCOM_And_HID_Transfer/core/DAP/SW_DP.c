@@ -25,14 +25,15 @@
  *
  *---------------------------------------------------------------------------*/
 
+#include <string.h>
 #include "DAP_config.h"
 #include "DAP.h"
 
 
 // SW Macros
 
-#define PIN_SWCLK_SET PIN_SWCLK_TCK_SET
-#define PIN_SWCLK_CLR PIN_SWCLK_TCK_CLR
+#define PIN_SWCLK_SET PIN_SWCLK_SWD_SET
+#define PIN_SWCLK_CLR PIN_SWCLK_SWD_CLR
 
 #define SW_CLOCK_CYCLE()                \
   PIN_SWCLK_CLR();                      \
@@ -57,6 +58,186 @@
 #define PIN_DELAY() PIN_DELAY_SLOW(DAP_Data.clock_delay)
 
 
+#if ((DAP_SWD != 0) && (DAP_SHADOW != 0))
+
+// Shadowed registers
+#define SHADOW_SELECT   (1U<<0)
+#define SHADOW_CSW      (1U<<1)
+#define SHADOW_TAR      (1U<<2)
+
+#define SHADOW_AP_CSW   0x00U           // MEM-AP bank 0 registers
+#define SHADOW_AP_TAR   0x04U
+#define SHADOW_AP_DRW   0x0CU
+#define SHADOW_AP_IDR   0x0CU           // Bank 0xF0
+
+#define SHADOW_IDR_CLASS 0x0001E000U    // IDR fields
+#define SHADOW_IDR_MEMAP 0x00010000U
+
+#define SHADOW_APSEL    0xFF000000U     // SELECT fields
+#define SHADOW_APBANK   0x000000F0U
+#define SHADOW_IDRBANK  0x000000F0U
+
+#define SHADOW_SIZE     0x00000007U     // CSW fields
+#define SHADOW_ADDRINC  0x00000030U
+#define SHADOW_SADDRINC 0x00000010U
+
+#define SHADOW_TAR_WRAP 0xFFFFFC00U     // Auto-increment is only defined within 1KB
+
+// DP SELECT and MEM-AP CSW/TAR as last left by any SWD transfer
+//   CSW/TAR writes are only skipped for APs whose IDR was read as MEM-AP.
+static struct {
+  uint8_t  valid;                       // SHADOW_* flags
+  uint32_t select;                      // DP SELECT
+  uint32_t csw;                         // CSW of the selected AP
+  uint32_t tar;                         // TAR of the selected AP after auto-increment
+  uint16_t idr;                         // Posted IDR read: 0x100 | APSEL, 0 = none
+  uint8_t  memap[256U/8U];              // APSEL bitmap of known MEM-APs
+} Shadow;
+
+
+// Forget all shadowed registers and AP classes (reconnect)
+void SWD_ShadowInvalidate (void) {
+  Shadow.valid = 0U;
+  Shadow.idr   = 0U;
+  memset(Shadow.memap, 0, sizeof(Shadow.memap));
+}
+
+
+// Learn the class of the AP whose IDR read completed
+static void SWD_ShadowClass (uint32_t idr) {
+  uint32_t apsel = Shadow.idr & 0xFFU;
+
+  if ((idr & SHADOW_IDR_CLASS) == SHADOW_IDR_MEMAP) {
+    Shadow.memap[apsel >> 3] |=  (uint8_t)(1U << (apsel & 7U));
+  } else {
+    Shadow.memap[apsel >> 3] &= ~(uint8_t)(1U << (apsel & 7U));
+  }
+  Shadow.idr = 0U;
+}
+
+
+// Check if a register write repeats the shadowed value
+//   request: A[3:2] RnW APnDP
+//   data:    DATA[31:0]
+//   return:  1 = write can be skipped, 0 = write needed
+uint32_t SWD_ShadowMatch (uint32_t request, uint32_t data) {
+  uint32_t addr;
+
+  if ((Shadow.valid & SHADOW_SELECT) == 0U) {
+    return (0U);
+  }
+
+  addr = request & (DAP_TRANSFER_A2 | DAP_TRANSFER_A3);
+
+  if ((request & DAP_TRANSFER_APnDP) == 0U) {
+    return (((addr == DP_SELECT) && (data == Shadow.select)) ? 1U : 0U);
+  }
+  if (((Shadow.select & SHADOW_APBANK) != 0U) ||
+      ((Shadow.memap[Shadow.select >> 27] & (1U << ((Shadow.select >> 24) & 7U))) == 0U)) {
+    return (0U);                        // Not bank 0 of a known MEM-AP
+  }
+  if (addr == SHADOW_AP_CSW) {
+    return (((Shadow.valid & SHADOW_CSW) && (data == Shadow.csw)) ? 1U : 0U);
+  }
+  if (addr == SHADOW_AP_TAR) {
+    return (((Shadow.valid & SHADOW_TAR) && (data == Shadow.tar)) ? 1U : 0U);
+  }
+  return (0U);
+}
+
+
+// Follow register state through a completed transfer
+static void SWD_ShadowUpdate (uint32_t request, const uint32_t *data, uint8_t ack) {
+  uint32_t addr;
+  uint32_t tar;
+
+  if (ack == DAP_TRANSFER_WAIT) {
+    return;                             // Not executed, retried by the caller
+  }
+  if (ack != DAP_TRANSFER_OK) {
+    Shadow.valid = 0U;
+    Shadow.idr   = 0U;
+    return;
+  }
+
+  addr = request & (DAP_TRANSFER_A2 | DAP_TRANSFER_A3);
+
+  if ((request & DAP_TRANSFER_APnDP) == 0U) {
+    if (request & DAP_TRANSFER_RnW) {
+      if (addr == DP_RDBUFF) {
+        if ((Shadow.idr != 0U) && (data != NULL)) {
+          SWD_ShadowClass(*data);       // Result of the posted IDR read
+        }
+        Shadow.idr = 0U;
+      }
+      return;
+    }
+    if (addr == DP_ABORT) {
+      Shadow.valid = 0U;
+    } else if (addr == DP_SELECT) {
+      if (((Shadow.valid & SHADOW_SELECT) == 0U) ||
+          ((Shadow.select ^ *data) & SHADOW_APSEL)) {
+        Shadow.valid = 0U;              // Other AP, its CSW/TAR are unknown
+      }
+      Shadow.select = *data;
+      Shadow.valid |= SHADOW_SELECT;
+    }
+    return;
+  }
+
+  if (request & DAP_TRANSFER_RnW) {
+    // AP reads are posted, the data is the result of the previous AP read
+    if ((Shadow.idr != 0U) && (data != NULL)) {
+      SWD_ShadowClass(*data);
+    }
+    Shadow.idr = 0U;
+    if ((Shadow.valid & SHADOW_SELECT) && (addr == SHADOW_AP_IDR) &&
+        ((Shadow.select & SHADOW_APBANK) == SHADOW_IDRBANK)) {
+      Shadow.idr = (uint16_t)(0x100U | (Shadow.select >> 24));
+    }
+  } else {
+    Shadow.idr = 0U;
+  }
+
+  if (((Shadow.valid & SHADOW_SELECT) == 0U) || (Shadow.select & SHADOW_APBANK)) {
+    return;                             // Not a bank 0 register (or unknown)
+  }
+
+  switch (addr) {
+    case SHADOW_AP_CSW:
+      if ((request & DAP_TRANSFER_RnW) == 0U) {
+        Shadow.csw = *data;
+        Shadow.valid |= SHADOW_CSW;
+      }
+      break;
+    case SHADOW_AP_TAR:
+      if ((request & DAP_TRANSFER_RnW) == 0U) {
+        Shadow.tar = *data;
+        Shadow.valid |= SHADOW_TAR;
+      }
+      break;
+    case SHADOW_AP_DRW:
+      if ((Shadow.valid & SHADOW_CSW) == 0U) {
+        Shadow.valid &= ~SHADOW_TAR;
+      } else if ((Shadow.csw & SHADOW_ADDRINC) == SHADOW_SADDRINC) {
+        tar = Shadow.tar + (1U << (Shadow.csw & SHADOW_SIZE));
+        if (((Shadow.csw & SHADOW_SIZE) > 2U) ||
+            ((tar ^ Shadow.tar) & SHADOW_TAR_WRAP)) {
+          Shadow.valid &= ~SHADOW_TAR;
+        }
+        Shadow.tar = tar;
+      } else if (Shadow.csw & SHADOW_ADDRINC) {
+        Shadow.valid &= ~SHADOW_TAR;    // Packed increment
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+#endif  /* ((DAP_SWD != 0) && (DAP_SHADOW != 0)) */
+
+
 // Generate SWJ Sequence
 //   count:  sequence bit count
 //   data:   pointer to sequence bit data
@@ -66,6 +247,10 @@ void SWJ_Sequence (uint32_t count, const uint8_t *data) {
   uint32_t val;
   uint32_t n;
 
+#if ((DAP_SWD != 0) && (DAP_SHADOW != 0))
+  SWD_ShadowInvalidate();               // Line reset or protocol switch
+#endif
+
   val = 0U;
   n = 0U;
   while (count--) {
@@ -78,7 +263,10 @@ void SWJ_Sequence (uint32_t count, const uint8_t *data) {
     } else {
       PIN_SWDIO_TMS_CLR();
     }
-    SW_CLOCK_CYCLE();
+    PIN_SWCLK_TCK_CLR();                    // SWCLK and TCK (JTAG reset/switch)
+    PIN_DELAY();
+    PIN_SWCLK_TCK_SET();
+    PIN_DELAY();
     val >>= 1;
     n--;
   }
@@ -97,6 +285,10 @@ void SWD_Sequence (uint32_t info, const uint8_t *swdo, uint8_t *swdi) {
   uint32_t bit;
   uint32_t n, k;
 
+#if (DAP_SHADOW != 0)
+  SWD_ShadowInvalidate();               // Line reset or dormant state switch
+#endif
+
   n = info & SWD_SEQUENCE_CLK;
   if (n == 0U) {
     n = 64U;
@@ -275,11 +467,24 @@ SWD_TransferFunction(Slow)
 //   data:    DATA[31:0]
 //   return:  ACK[2:0]
 uint8_t  SWD_Transfer(uint32_t request, uint32_t *data) {
+  uint8_t ack;
+
   if (DAP_Data.fast_clock) {
-    return SWD_TransferFast(request, data);
+    ack = SWD_TransferFast(request, data);
   } else {
-    return SWD_TransferSlow(request, data);
+    ack = SWD_TransferSlow(request, data);
   }
+
+  // Track DP SELECT so that background accesses can restore it
+  if ((ack == DAP_TRANSFER_OK) &&
+      ((request & (DAP_TRANSFER_APnDP | DAP_TRANSFER_RnW | DAP_TRANSFER_A2 | DAP_TRANSFER_A3)) == DP_SELECT)) {
+    DAP_Data.dp_select = *data;
+  }
+#if (DAP_SHADOW != 0)
+  SWD_ShadowUpdate(request, data, ack);
+#endif
+
+  return (ack);
 }
 
 
@@ -0,0 +1,506 @@
+/******************************************************************************
+ * @file     XSVF.c
+ * @brief    On-probe XSVF player for boundary-scan and CPLD programming.
+ *
+ * @note
+ *           The host streams the XSVF file with the ID_DAP_XSVF vendor
+ *           command. Each packet is interpreted as soon as it arrives; the
+ *           JTAG shifts, TDO compares, retries and XRUNTEST waits run on
+ *           the probe and only the player state is returned.
+ *
+ *           SVF files are converted to XSVF on the host (e.g. svf2xsvf).
+ *
+ *           Supported instructions: XCOMPLETE, XTDOMASK, XSIR, XSIR2, XSDR,
+ *           XRUNTEST, XREPEAT, XSDRSIZE, XSDRTDO, XSDRB/C/E, XSDRTDOB/C/E,
+ *           XSTATE, XENDIR, XENDDR, XCOMMENT, XWAIT, XWAITSTATE and XTRST.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *****************************************************************************/
+
+#include <string.h>
+#include "DAP_config.h"
+#include "DAP.h"
+
+#if ((DAP_JTAG != 0) && (XSVF_MAX_BITS != 0U))
+
+// XSVF instructions
+#define XCOMPLETE       0x00U
+#define XTDOMASK        0x01U
+#define XSIR            0x02U
+#define XSDR            0x03U
+#define XRUNTEST        0x04U
+#define XREPEAT         0x07U
+#define XSDRSIZE        0x08U
+#define XSDRTDO         0x09U
+#define XSDRB           0x0CU
+#define XSDRC           0x0DU
+#define XSDRE           0x0EU
+#define XSDRTDOB        0x0FU
+#define XSDRTDOC        0x10U
+#define XSDRTDOE        0x11U
+#define XSTATE          0x12U
+#define XENDIR          0x13U
+#define XENDDR          0x14U
+#define XSIR2           0x15U
+#define XCOMMENT        0x16U
+#define XWAIT           0x17U
+#define XWAITSTATE      0x18U
+#define XTRST           0x1CU
+
+// TAP states (XSVF encoding)
+#define TAP_RESET       0x00U
+#define TAP_IDLE        0x01U
+#define TAP_SHIFTDR     0x04U
+#define TAP_EXIT1DR     0x05U
+#define TAP_PAUSEDR     0x06U
+#define TAP_EXIT2DR     0x07U
+#define TAP_SHIFTIR     0x0BU
+#define TAP_PAUSEIR     0x0DU
+
+#define XSVF_REPEAT_DEFAULT 32U
+#define XSVF_BYTES      ((XSVF_MAX_BITS + 7U) / 8U)
+
+// TAP next state: [state][TMS]
+static const uint8_t TAP_Next[16][2] = {
+  {  1,  0 }, {  1,  2 }, {  3,  9 }, {  4,  5 },
+  {  4,  5 }, {  6,  8 }, {  6,  7 }, {  4,  8 },
+  {  1,  2 }, { 10,  0 }, { 11, 12 }, { 11, 12 },
+  { 13, 15 }, { 13, 14 }, { 11, 15 }, {  1,  2 }
+};
+
+static struct {
+  uint8_t  state;               // Player state (XSVF_STATE_*)
+  uint8_t  error;               // Error code (XSVF_ERROR_*)
+  uint8_t  tap;                 // Current TAP state
+  uint8_t  end_ir;              // TAP state after IR shift
+  uint8_t  end_dr;              // TAP state after DR shift
+  uint8_t  repeat;              // Retries on TDO mismatch
+  uint16_t cmd_len;             // Bytes of current instruction received
+  uint32_t sdr_size;            // DR length in bits
+  uint32_t runtest;             // Run-Test/Idle time in us
+  uint32_t offset;              // Stream offset of current instruction
+} XSVF;
+
+static uint8_t XSVF_Cmd[3U + (2U * XSVF_BYTES)];        // Current instruction
+static uint8_t XSVF_TDOExpected[XSVF_BYTES];            // Expected TDO (LSB first)
+static uint8_t XSVF_TDOMask[XSVF_BYTES];                // TDO compare mask (LSB first)
+static uint8_t XSVF_TDO[XSVF_BYTES];                    // Captured TDO (LSB first)
+
+
+// Get big-endian value from XSVF stream
+//   data:   pointer to data
+//   num:    number of bytes
+//   return: value
+static uint32_t XSVF_Value (const uint8_t *data, uint32_t num) {
+  uint32_t val = 0U;
+
+  while (num--) {
+    val = (val << 8) | *data++;
+  }
+  return (val);
+}
+
+// Convert XSVF vector (MSB byte first) into shift order (LSB byte first)
+//   data:   pointer to vector
+//   num:    number of bytes
+//   return: none
+static void XSVF_Reverse (uint8_t *data, uint32_t num) {
+  uint8_t *end = data + num - 1U;
+  uint8_t  val;
+
+  while (data < end) {
+    val    = *data;
+    *data++ = *end;
+    *end-- = val;
+  }
+}
+
+// Move TAP to state over the shortest path
+//   state:  target TAP state
+//   return: none
+static void XSVF_Goto (uint32_t state) {
+  uint8_t  dist[16];
+  uint32_t tms;
+  uint32_t n, s, d;
+
+  if (state == TAP_RESET) {
+    JTAG_Sequence(5U | JTAG_SEQUENCE_TMS, (const uint8_t *)"\xFF", NULL);
+    XSVF.tap = TAP_RESET;
+    return;
+  }
+
+  // Distance of every state to the target (Bellman-Ford over 16 states)
+  memset(dist, 0xFF, sizeof(dist));
+  dist[state] = 0U;
+  for (d = 0U; d < 16U; d++) {
+    for (s = 0U; s < 16U; s++) {
+      for (n = 0U; n < 2U; n++) {
+        if ((dist[TAP_Next[s][n]] != 0xFFU) && (dist[s] > (dist[TAP_Next[s][n]] + 1U))) {
+          dist[s] = dist[TAP_Next[s][n]] + 1U;
+        }
+      }
+    }
+  }
+
+  while (XSVF.tap != state) {
+    tms = (dist[TAP_Next[XSVF.tap][1]] < dist[TAP_Next[XSVF.tap][0]]) ? 1U : 0U;
+    JTAG_Sequence(1U | (tms ? JTAG_SEQUENCE_TMS : 0U), (const uint8_t *)"\xFF", NULL);
+    XSVF.tap = TAP_Next[XSVF.tap][tms];
+  }
+}
+
+// Wait in current TAP state, clocking TCK when the state is stable
+//   clocks: minimum number of TCK cycles
+//   usec:   minimum time in us
+//   return: none
+static void XSVF_Wait (uint32_t clocks, uint32_t usec) {
+  uint32_t stable;
+  uint32_t info;
+  uint32_t tick;
+  uint32_t time;
+  uint32_t n;
+
+  stable = (XSVF.tap == TAP_RESET) || (XSVF.tap == TAP_IDLE) ||
+           (XSVF.tap == TAP_PAUSEDR) || (XSVF.tap == TAP_PAUSEIR);
+  info   = (XSVF.tap == TAP_RESET) ? JTAG_SEQUENCE_TMS : 0U;
+
+  if (stable) {
+    while (clocks) {
+      n = (clocks > 64U) ? 64U : clocks;
+      JTAG_Sequence((n & JTAG_SEQUENCE_TCK) | info, (const uint8_t *)"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF", NULL);
+      clocks -= n;
+    }
+  }
+
+  while (usec) {
+    time  = (usec > 1000000U) ? 1000000U : usec;
+    usec -= time;
+    time *= TIMESTAMP_CLOCK / 1000000U;
+    tick  = TIMESTAMP_GET();
+    while ((TIMESTAMP_GET() - tick) < time) {
+      if (stable) {
+        JTAG_Sequence(8U | info, (const uint8_t *)"\xFF", NULL);
+      }
+    }
+  }
+}
+
+// Shift data through the current shift state
+//   tdi:    TDI data (LSB first)
+//   tdo:    TDO capture buffer (LSB first) or NULL
+//   bits:   number of bits
+//   exit:   leave shift state with the last bit
+//   return: none
+static void XSVF_Shift (const uint8_t *tdi, uint8_t *tdo, uint32_t bits, uint32_t exit) {
+  uint32_t info;
+  uint32_t num;
+  uint32_t last;
+  uint8_t  val;
+
+  if (bits == 0U) {
+    return;
+  }
+  info = (tdo != NULL) ? JTAG_SEQUENCE_TDO : 0U;
+  last = bits - 1U;
+  num  = exit ? last : bits;
+
+  while (num) {
+    if (num >= 64U) {
+      JTAG_Sequence(info, tdi, tdo);
+      num -= 64U;
+      tdi += 8U;
+      if (tdo != NULL) {
+        tdo += 8U;
+      }
+    } else {
+      JTAG_Sequence(info | num, tdi, tdo);
+      num = 0U;
+    }
+  }
+
+  if (exit) {
+    tdi -= (last & ~63U) >> 3;
+    val  = (uint8_t)((tdi[last >> 3] >> (last & 7U)) & 1U);
+    JTAG_Sequence(info | JTAG_SEQUENCE_TMS | 1U, &val, &val);
+    if (tdo != NULL) {
+      tdo -= (last & ~63U) >> 3;
+      if ((last & 7U) == 0U) {
+        tdo[last >> 3]  = val & 1U;
+      } else {
+        tdo[last >> 3] |= (uint8_t)((val & 1U) << (last & 7U));
+      }
+    }
+    XSVF.tap++;                 // Shift-xR -> Exit1-xR
+  }
+}
+
+// Shift DR or IR with TDO compare and retries
+//   shift:  TAP shift state (TAP_SHIFTDR or TAP_SHIFTIR)
+//   tdi:    TDI data (LSB first)
+//   bits:   number of bits
+//   check:  compare TDO against expected value
+//   begin:  enter shift state first
+//   exit:   leave shift state and go to end state
+//   return: 0 = OK, 1 = TDO mismatch
+static uint32_t XSVF_Scan (uint32_t shift, const uint8_t *tdi, uint32_t bits,
+                           uint32_t check, uint32_t begin, uint32_t exit) {
+  uint32_t runtest;
+  uint32_t retry;
+  uint32_t n;
+
+  runtest = XSVF.runtest;
+  retry   = 0U;
+
+  if (begin) {
+    XSVF_Goto(shift);
+  }
+  for (;;) {
+    XSVF_Shift(tdi, check ? XSVF_TDO : NULL, bits, exit);
+    if (check) {
+      for (n = 0U; n < ((bits + 7U) / 8U); n++) {
+        if ((XSVF_TDO[n] ^ XSVF_TDOExpected[n]) & XSVF_TDOMask[n]) {
+          break;
+        }
+      }
+      if (n != ((bits + 7U) / 8U)) {
+        if (!exit || (runtest == 0U) || (retry++ >= XSVF.repeat)) {
+          return (1U);
+        }
+        // Retry after waiting in Run-Test/Idle 25% longer
+        runtest += runtest >> 2;
+        XSVF_Goto(TAP_IDLE);
+        XSVF_Wait(0U, runtest);
+        XSVF_Goto(shift);
+        continue;
+      }
+    }
+    break;
+  }
+
+  if (exit) {
+    if (runtest != 0U) {
+      XSVF_Goto(TAP_IDLE);
+      XSVF_Wait(0U, runtest);
+    }
+    XSVF_Goto((shift == TAP_SHIFTIR) ? XSVF.end_ir : XSVF.end_dr);
+  }
+  return (0U);
+}
+
+// Get length of current instruction
+//   return: number of bytes needed, 0 = unsupported instruction
+static uint32_t XSVF_Length (void) {
+  uint32_t dr = (XSVF.sdr_size + 7U) / 8U;
+
+  switch (XSVF_Cmd[0]) {
+    case XCOMPLETE:
+      return (1U);
+    case XTDOMASK:
+    case XSDR:
+    case XSDRB:
+    case XSDRC:
+    case XSDRE:
+      return (1U + dr);
+    case XSDRTDO:
+    case XSDRTDOB:
+    case XSDRTDOC:
+    case XSDRTDOE:
+      return (1U + (2U * dr));
+    case XSIR:
+      return ((XSVF.cmd_len < 2U) ? 2U : (2U + ((XSVF_Cmd[1] + 7U) / 8U)));
+    case XSIR2:
+      return ((XSVF.cmd_len < 3U) ? 3U : (3U + ((XSVF_Value(&XSVF_Cmd[1], 2U) + 7U) / 8U)));
+    case XRUNTEST:
+    case XSDRSIZE:
+      return (5U);
+    case XREPEAT:
+    case XSTATE:
+    case XENDIR:
+    case XENDDR:
+    case XTRST:
+      return (2U);
+    case XWAIT:
+      return (7U);
+    case XWAITSTATE:
+      return (11U);
+    default:
+      return (0U);
+  }
+}
+
+// Execute current instruction
+//   return: error code (XSVF_ERROR_*)
+static uint32_t XSVF_Execute (void) {
+  uint8_t *data = &XSVF_Cmd[1];
+  uint32_t dr   = (XSVF.sdr_size + 7U) / 8U;
+  uint32_t bits;
+  uint32_t op;
+
+  op = XSVF_Cmd[0];
+  switch (op) {
+    case XCOMPLETE:
+      XSVF.state = XSVF_STATE_COMPLETE;
+      break;
+    case XTDOMASK:
+      XSVF_Reverse(data, dr);
+      memcpy(XSVF_TDOMask, data, dr);
+      break;
+    case XSIR:
+    case XSIR2:
+      bits  = (op == XSIR) ? data[0] : XSVF_Value(data, 2U);
+      data += (op == XSIR) ? 1U : 2U;
+      XSVF_Reverse(data, (bits + 7U) / 8U);
+      XSVF_Scan(TAP_SHIFTIR, data, bits, 0U, 1U, 1U);
+      break;
+    case XSDRTDO:
+    case XSDRTDOB:
+    case XSDRTDOC:
+    case XSDRTDOE:
+      XSVF_Reverse(data + dr, dr);
+      memcpy(XSVF_TDOExpected, data + dr, dr);
+      /* FALLTHROUGH */
+    case XSDR:
+    case XSDRB:
+    case XSDRC:
+    case XSDRE:
+      XSVF_Reverse(data, dr);
+      if (XSVF_Scan(TAP_SHIFTDR, data, XSVF.sdr_size,
+                    (op == XSDR) || (op == XSDRTDO) || (op >= XSDRTDOB),
+                    (op == XSDR) || (op == XSDRTDO) || (op == XSDRB) || (op == XSDRTDOB),
+                    (op == XSDR) || (op == XSDRTDO) || (op == XSDRE) || (op == XSDRTDOE))) {
+        return (XSVF_ERROR_TDO);
+      }
+      break;
+    case XRUNTEST:
+      XSVF.runtest = XSVF_Value(data, 4U);
+      break;
+    case XREPEAT:
+      XSVF.repeat = data[0];
+      break;
+    case XSDRSIZE:
+      bits = XSVF_Value(data, 4U);
+      if (bits > XSVF_MAX_BITS) {
+        return (XSVF_ERROR_SIZE);
+      }
+      XSVF.sdr_size = bits;
+      break;
+    case XSTATE:
+      if (data[0] > 15U) {
+        return (XSVF_ERROR_FORMAT);
+      }
+      XSVF_Goto(data[0]);
+      break;
+    case XENDIR:
+      XSVF.end_ir = data[0] ? TAP_PAUSEIR : TAP_IDLE;
+      break;
+    case XENDDR:
+      XSVF.end_dr = data[0] ? TAP_PAUSEDR : TAP_IDLE;
+      break;
+    case XWAIT:
+    case XWAITSTATE:
+      if ((data[0] > 15U) || (data[1] > 15U)) {
+        return (XSVF_ERROR_FORMAT);
+      }
+      XSVF_Goto(data[0]);
+      if (op == XWAIT) {
+        XSVF_Wait(0U, XSVF_Value(&data[2], 4U));
+      } else {
+        XSVF_Wait(XSVF_Value(&data[2], 4U), XSVF_Value(&data[6], 4U));
+      }
+      XSVF_Goto(data[1]);
+      break;
+    case XTRST:
+      if (data[0] <= 1U) {
+        PIN_nTRST_OUT(data[0]);       // 0 = on (low), 1 = off (high)
+      }
+      break;
+  }
+  return (XSVF_ERROR_NONE);
+}
+
+// Interpret XSVF stream data
+//   data:   pointer to data
+//   num:    number of bytes
+//   return: none
+static void XSVF_Input (const uint8_t *data, uint32_t num) {
+  uint32_t need;
+
+  for (; num && (XSVF.state == XSVF_STATE_RUNNING); num--) {
+    if ((XSVF.cmd_len == 1U) && (XSVF_Cmd[0] == XCOMMENT)) {
+      // Comment: skip text up to terminating zero
+      if (*data++ == 0U) {
+        XSVF.cmd_len = 0U;
+        XSVF.offset++;
+      }
+      XSVF.offset++;
+      continue;
+    }
+
+    XSVF_Cmd[XSVF.cmd_len++] = *data++;
+    if (XSVF_Cmd[0] == XCOMMENT) {
+      continue;
+    }
+
+    need = XSVF_Length();
+    if (need == 0U) {
+      XSVF.error = XSVF_ERROR_UNSUPPORTED;
+    } else if (need > sizeof(XSVF_Cmd)) {
+      XSVF.error = XSVF_ERROR_SIZE;
+    } else if (XSVF.cmd_len == need) {
+      XSVF.error   = (uint8_t)XSVF_Execute();
+      XSVF.cmd_len = 0U;
+      if (XSVF.error == XSVF_ERROR_NONE) {
+        XSVF.offset += need;
+      }
+    }
+    if (XSVF.error != XSVF_ERROR_NONE) {
+      XSVF.state = XSVF_STATE_ERROR;
+    }
+  }
+}
+
+// Process XSVF command and prepare response
+//   request:  pointer to request data
+//             [0] control: bit0 = start new file
+//             [1] number of stream bytes, followed by stream data
+//   response: pointer to response data
+//             status, player state, error code, stream offset (4 bytes)
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t XSVF_Command (const uint8_t *request, uint8_t *response) {
+  uint32_t control;
+  uint32_t num;
+
+  control = request[0];
+  num     = request[1];
+
+  if ((num > (DAP_PACKET_SIZE - 3U)) || (DAP_Data.debug_port != DAP_PORT_JTAG)) {
+    *response = DAP_ERROR;
+    return (((2U + num) << 16) | 1U);
+  }
+
+  if (control & XSVF_CONTROL_START) {
+    memset(&XSVF, 0, sizeof(XSVF));
+    memset(XSVF_TDOMask, 0xFF, sizeof(XSVF_TDOMask));
+    XSVF.state  = XSVF_STATE_RUNNING;
+    XSVF.tap    = TAP_RESET;
+    XSVF.end_ir = TAP_IDLE;
+    XSVF.end_dr = TAP_IDLE;
+    XSVF.repeat = XSVF_REPEAT_DEFAULT;
+    XSVF_Goto(TAP_RESET);
+  }
+
+  XSVF_Input(&request[2], num);
+
+  response[0] = DAP_OK;
+  response[1] = XSVF.state;
+  response[2] = XSVF.error;
+  response[3] = (uint8_t)(XSVF.offset >>  0);
+  response[4] = (uint8_t)(XSVF.offset >>  8);
+  response[5] = (uint8_t)(XSVF.offset >> 16);
+  response[6] = (uint8_t)(XSVF.offset >> 24);
+
+  return (((2U + num) << 16) | 7U);
+}
+
+#endif
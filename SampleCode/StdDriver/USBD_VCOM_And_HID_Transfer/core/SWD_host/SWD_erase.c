@@ -0,0 +1,259 @@
+/**
+ * @file    SWD_erase.c
+ * @brief   Erase planner for flash programming sessions
+ *
+ * The planner walks the image ranges over the device sector map to count
+ * the sectors the image touches. If allowed, it picks one chip erase when
+ * that is estimated to be faster than erasing the touched sectors one by
+ * one. Otherwise sectors are erased lazily, just before the first page
+ * inside them is programmed, each sector once. A sector is blank checked
+ * with the algorithm's crc entry first when that is estimated to be
+ * cheaper than erasing it, and left alone if it is already blank.
+ * Estimates use the durations of earlier operations.
+ *
+ * The sector map follows sector_info_t: each region starts at start and
+ * holds sectors of size bytes up to the next region.
+ */
+#include "SWD_erase.h"
+
+#include "DAP_config.h"
+
+
+#define ERASE_US(ticks)         ((ticks) / (TIMESTAMP_CLOCK / 1000000U))
+
+// Cost estimates in us until an operation has been measured
+#define ERASE_COST_SECTOR       20000U      // Sector erase
+#define ERASE_COST_CHIP         200000U     // Chip erase
+#define ERASE_COST_BLANK        1000U       // Blank check per KB
+
+static sector_info_t MapBuf[ERASE_MAP_MAX];    // Sector map set by the host
+
+static struct {
+    const sector_info_t *map;           // Sector map regions in ascending order
+    uint32_t count;                     // Number of regions
+    uint32_t sectors;                   // Sectors touched by the image ranges
+    uint32_t covered;                   // End of the counted sectors
+    uint32_t erased;                    // End of the erased sectors
+    uint8_t chip;                       // Chip erased, nothing left to erase
+} plan;
+
+// Measured costs in us, kept across sessions
+static struct {
+    uint32_t sector;
+    uint32_t chip;
+    uint32_t blank;                     // Per KB
+} cost = { ERASE_COST_SECTOR, ERASE_COST_CHIP, ERASE_COST_BLANK };
+
+// CRC of the last blank checked sector size
+static uint32_t blank_size;
+static uint32_t blank_crc;
+
+
+// Running average of an operation's duration, per unit of work.
+static void erase_cost(uint32_t *avg, uint32_t start, uint32_t units)
+{
+    uint32_t us = ERASE_US(TIMESTAMP_GET() - start) / units;
+
+    *avg = (*avg * 3U + us) / 4U;
+}
+
+// Find the sector holding addr.
+static uint8_t erase_sector_of(uint32_t addr, uint32_t *sector, uint32_t *size)
+{
+    const sector_info_t *region = 0;
+    uint32_t i;
+
+    for (i = 0; i < plan.count; i++) {
+        if (plan.map[i].start > addr) {
+            break;
+        }
+
+        region = &plan.map[i];
+    }
+
+    if ((region == 0) || (region->size == 0)) {
+        return 0;
+    }
+
+    *sector = addr - ((addr - region->start) % region->size);
+    *size = region->size;
+    return 1;
+}
+
+// Check with the target crc entry whether a sector reads as erased.
+static uint8_t erase_blank(uint32_t sector, uint32_t size)
+{
+    uint32_t crc, i;
+
+    if (blank_size != size) {
+        CRC_Open(CRC_32, FLASH_CRC_ATTR, 0xFFFFFFFF, CRC_WDATA_32);
+
+        for (i = 0; i < size; i += 4) {
+            CRC_WRITE_DATA(0xFFFFFFFF);
+        }
+
+        blank_crc = CRC_GetChecksum();
+        blank_size = size;
+    }
+
+    if (target_flash_crc(sector, size, &crc) != ERROR_SUCCESS) {
+        return 0;
+    }
+
+    return (crc == blank_crc) ? 1 : 0;
+}
+
+// Erase one sector unless a cheaper blank check shows it is erased.
+static error_t erase_sector(uint32_t sector, uint32_t size)
+{
+    uint32_t start;
+    error_t status;
+    uint8_t blank;
+
+    if ((target_flash_algo()->crc != 0) && ((cost.blank * ((size + 1023U) / 1024U)) < cost.sector)) {
+        start = TIMESTAMP_GET();
+        blank = erase_blank(sector, size);
+        erase_cost(&cost.blank, start, (size >= 1024U) ? (size / 1024U) : 1U);
+
+        if (blank) {
+            return ERROR_SUCCESS;
+        }
+    }
+
+    start = TIMESTAMP_GET();
+    status = target_flash_erase_sector(sector);
+    erase_cost(&cost.sector, start, 1U);
+
+    return status;
+}
+
+// Start a new plan with an empty sector map.
+void erase_plan_init(void)
+{
+    plan.map = MapBuf;
+    plan.count = 0;
+    plan.sectors = 0;
+    plan.covered = 0;
+    plan.erased = 0;
+    plan.chip = 0;
+}
+
+// Use a sector map held elsewhere, for example a compiled in one.
+void erase_plan_map(const sector_info_t *map, uint32_t count)
+{
+    plan.map = map;
+    plan.count = count;
+}
+
+// Append a region to the sector map, regions must be in ascending order.
+uint8_t erase_plan_region(uint32_t start, uint32_t size)
+{
+    if ((plan.map != MapBuf) || (plan.count >= ERASE_MAP_MAX) || (size == 0) ||
+        ((plan.count != 0) && (start <= MapBuf[plan.count - 1].start))) {
+        return 0;
+    }
+
+    MapBuf[plan.count].start = start;
+    MapBuf[plan.count].size = size;
+    plan.count++;
+    return 1;
+}
+
+// Add an image range, ranges must be in ascending order.
+uint8_t erase_plan_range(uint32_t start, uint32_t size)
+{
+    uint32_t addr = start;
+    uint32_t end = start + size;
+    uint32_t sector, n;
+
+    if (addr < plan.covered) {
+        addr = plan.covered;
+    }
+
+    while (addr < end) {
+        if (!erase_sector_of(addr, &sector, &n)) {
+            return 0;
+        }
+
+        plan.sectors++;
+        addr = sector + n;
+    }
+
+    if (addr > plan.covered) {
+        plan.covered = addr;
+    }
+
+    return 1;
+}
+
+// Sectors touched by the image ranges.
+uint32_t erase_plan_sectors(void)
+{
+    return plan.sectors;
+}
+
+// Check that pages of size bytes never share a sector with another page.
+uint8_t erase_plan_fits(uint32_t size)
+{
+    uint32_t i;
+
+    for (i = 0; i < plan.count; i++) {
+        if ((plan.map[i].size == 0) || ((size % plan.map[i].size) != 0)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Decide between chip and sector erase, before anything is programmed.
+error_t erase_plan_begin(uint8_t mode)
+{
+    uint32_t start;
+    error_t status;
+
+    if ((mode == ERASE_PLAN_SECTOR) ||
+        ((mode == ERASE_PLAN_AUTO) &&
+         ((plan.sectors == 0) || (target_flash_algo()->erase_chip == 0) ||
+          (cost.chip >= (plan.sectors * cost.sector))))) {
+        return ERROR_SUCCESS;
+    }
+
+    start = TIMESTAMP_GET();
+    status = target_flash_erase_chip();
+    erase_cost(&cost.chip, start, 1U);
+
+    plan.chip = (status == ERROR_SUCCESS) ? 1 : 0;
+    return status;
+}
+
+// Make sure the sectors holding start to end are erased.
+error_t erase_plan_erase(uint32_t start, uint32_t end)
+{
+    uint32_t sector, size;
+    error_t status;
+
+    if (plan.chip || (plan.count == 0)) {
+        return ERROR_SUCCESS;
+    }
+
+    if (plan.erased < start) {
+        plan.erased = start;
+    }
+
+    while (plan.erased < end) {
+        if (!erase_sector_of(plan.erased, &sector, &size)) {
+            return ERROR_ERASE_SECTOR;
+        }
+
+        status = erase_sector(sector, size);
+
+        if (status != ERROR_SUCCESS) {
+            return status;
+        }
+
+        plan.erased = sector + size;
+    }
+
+    return ERROR_SUCCESS;
+}
@@ -0,0 +1,27 @@
+#ifndef __SWD_ERASE_H__
+#define __SWD_ERASE_H__
+
+#include <stdint.h>
+
+#include "SWD_flash.h"
+
+
+#define ERASE_MAP_MAX       7       // Sector map regions held in RAM
+
+// erase_plan_begin() modes
+#define ERASE_PLAN_SECTOR   0       // Erase sectors ahead of programming
+#define ERASE_PLAN_AUTO     1       // Chip erase if estimated faster
+#define ERASE_PLAN_CHIP     2       // Chip erase
+
+
+void erase_plan_init(void);
+void erase_plan_map(const sector_info_t *map, uint32_t count);
+uint8_t erase_plan_region(uint32_t start, uint32_t size);
+uint8_t erase_plan_range(uint32_t start, uint32_t size);
+uint32_t erase_plan_sectors(void);
+uint8_t erase_plan_fits(uint32_t size);
+error_t erase_plan_begin(uint8_t mode);
+error_t erase_plan_erase(uint32_t start, uint32_t end);
+
+
+#endif // __SWD_ERASE_H__
@@ -6,64 +6,175 @@
 #include "SWD_flash.h"
 
 
-extern const program_target_t flash_algo;
+// Flash algorithm Init() function codes
+#define FLASH_FUNC_NONE     0
+#define FLASH_FUNC_ERASE    1
+#define FLASH_FUNC_PROGRAM  2
+#define FLASH_FUNC_VERIFY   3
 
+static program_target_t flash_algo;     // Algorithm in use
+static uint32_t flash_start;            // Init() address argument
+static uint32_t flash_func;             // Function the algorithm is initialised for
+static uint8_t flash_busy;              // ProgramPage still running on the target
+static uint8_t flash_buf;               // Program buffer to fill next (0/1)
 
-error_t target_flash_init(uint32_t flash_start, uint32_t func)
+
+// Wait for a ProgramPage left running by target_flash_program_buffer().
+static error_t target_flash_wait(void)
 {
-	if(func == 0)
-	{
-		if (0 == swd_set_target_state_hw(RESET_PROGRAM)) {
-			return ERROR_RESET;
-		}
-
-		// Download flash programming algorithm to target and initialise.
-		if (0 == swd_write_memory(flash_algo.algo_start, (uint8_t *)flash_algo.algo_blob, flash_algo.algo_size)) {
-			return ERROR_ALGO_DL;
-		}
-	}
-	else
-	{
-		if (0 != swd_flash_syscall_exec(&flash_algo.sys_call_s, flash_algo.init, flash_start, 0, func, 0)) {
-			return ERROR_INIT;
-		}
-	}
+    if (!flash_busy) {
+        return ERROR_SUCCESS;
+    }
+
+    flash_busy = 0;
+
+    if (!swd_flash_syscall_result()) {
+        return ERROR_WRITE;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+// Initialise the algorithm for func, uninitialising the previous function.
+static error_t target_flash_func(uint32_t func)
+{
+    error_t status;
+
+    status = target_flash_wait();
+
+    if (status != ERROR_SUCCESS) {
+        flash_func = FLASH_FUNC_NONE;
+        return status;
+    }
+
+    if (flash_func == func) {
+        return ERROR_SUCCESS;
+    }
+
+    if (flash_func != FLASH_FUNC_NONE) {
+        if (flash_algo.uninit &&
+            !swd_flash_syscall_exec(&flash_algo.sys_call_s, flash_algo.uninit, flash_func, 0, 0, 0)) {
+            flash_func = FLASH_FUNC_NONE;
+            return ERROR_UNINIT;
+        }
+
+        flash_func = FLASH_FUNC_NONE;
+    }
+
+    if (func != FLASH_FUNC_NONE) {
+        if (flash_algo.init &&
+            !swd_flash_syscall_exec(&flash_algo.sys_call_s, flash_algo.init, flash_start, 0, func, 0)) {
+            return ERROR_INIT;
+        }
+
+        flash_func = func;
+    }
 
     return ERROR_SUCCESS;
 }
 
-error_t target_flash_uninit(uint32_t func)
+// Select the flash algorithm for the following operations. An algorithm
+// with a blob is downloaded after a reset into programming state, with
+// algo_size 0 the host has already loaded it and halted the target.
+error_t target_flash_init(const program_target_t *algo, uint32_t start)
 {
-    if (0 != swd_flash_syscall_exec(&flash_algo.sys_call_s, flash_algo.init, func, 0, 0, 0)) {
-		return ERROR_UNINIT;
-	}
-	
+    flash_algo = *algo;
+    flash_start = start;
+    flash_func = FLASH_FUNC_NONE;
+    flash_busy = 0;
+    flash_buf = 0;
+
+    if (flash_algo.algo_size != 0) {
+        if (!swd_set_target_state_hw(RESET_PROGRAM)) {
+            return ERROR_RESET;
+        }
+
+        // Download flash programming algorithm to target
+        if (!swd_write_memory(flash_algo.algo_start, (uint8_t *)flash_algo.algo_blob, flash_algo.algo_size)) {
+            return ERROR_ALGO_DL;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+// Uninitialise the algorithm, waiting for a running ProgramPage first.
+error_t target_flash_uninit(void)
+{
+    return target_flash_func(FLASH_FUNC_NONE);
+}
+
+// Algorithm in use.
+const program_target_t *target_flash_algo(void)
+{
+    return &flash_algo;
+}
+
+// Program buffer to fill with the next page. With a second buffer it is
+// free while the previous page is still being programmed.
+uint32_t target_flash_buffer(void)
+{
+    return flash_buf ? flash_algo.program_buffer_2 : flash_algo.program_buffer;
+}
+
+// Program size bytes already in target_flash_buffer() to addr. With a
+// second buffer the target is left running and the buffers swapped, the
+// result is collected before the next algorithm call.
+error_t target_flash_program_buffer(uint32_t addr, uint32_t size)
+{
+    error_t status;
+
+    status = target_flash_func(FLASH_FUNC_PROGRAM);
+
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+
+    if (!swd_flash_syscall_start(&flash_algo.sys_call_s,
+                                 flash_algo.program_page,
+                                 addr,
+                                 size,
+                                 target_flash_buffer(),
+                                 0)) {
+        return ERROR_WRITE;
+    }
+
+    if (flash_algo.program_buffer_2 != 0) {
+        flash_busy = 1;
+        flash_buf ^= 1;
+        return ERROR_SUCCESS;
+    }
+
+    if (!swd_flash_syscall_result()) {
+        return ERROR_WRITE;
+    }
+
     return ERROR_SUCCESS;
 }
 
 error_t target_flash_program_page(uint32_t addr, const uint8_t *buf, uint32_t size)
 {
+    error_t status;
+
     while (size > 0) {
         uint32_t write_size = size > flash_algo.program_buffer_size ? flash_algo.program_buffer_size : size;
 
         // Write page to buffer
-        if (!swd_write_memory(flash_algo.program_buffer, (uint8_t *)buf, write_size)) {
+        if (!swd_write_memory(target_flash_buffer(), (uint8_t *)buf, write_size)) {
             return ERROR_ALGO_DATA_SEQ;
         }
 
         // Run flash programming
-        if (swd_flash_syscall_exec(&flash_algo.sys_call_s,
-                                    flash_algo.program_page,
-                                    addr,
-                                    flash_algo.program_buffer_size,
-                                    flash_algo.program_buffer,
-                                    0)) {
-            return ERROR_WRITE;
+        status = target_flash_program_buffer(addr, write_size);
+
+        if (status != ERROR_SUCCESS) {
+            return status;
         }
-        
-		addr += write_size;
-		buf  += write_size;
-		size -= write_size;
+
+        addr += write_size;
+        buf  += write_size;
+        size -= write_size;
     }
 
     return ERROR_SUCCESS;
@@ -71,7 +182,15 @@ error_t target_flash_program_page(uint32_t addr, const uint8_t *buf, uint32_t si
 
 error_t target_flash_erase_sector(uint32_t addr)
 {
-    if (0 != swd_flash_syscall_exec(&flash_algo.sys_call_s, flash_algo.erase_sector, addr, 0, 0, 0)) {
+    error_t status;
+
+    status = target_flash_func(FLASH_FUNC_ERASE);
+
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+
+    if (!swd_flash_syscall_exec(&flash_algo.sys_call_s, flash_algo.erase_sector, addr, 0, 0, 0)) {
         return ERROR_ERASE_SECTOR;
     }
 
@@ -80,11 +199,42 @@ error_t target_flash_erase_sector(uint32_t addr)
 
 error_t target_flash_erase_chip(void)
 {
-    error_t status = ERROR_SUCCESS;
+    error_t status;
+
+    if (flash_algo.erase_chip == 0) {
+        return ERROR_ERASE_ALL;         // Algorithm without chip erase
+    }
+
+    status = target_flash_func(FLASH_FUNC_ERASE);
 
-    if (0 != swd_flash_syscall_exec(&flash_algo.sys_call_s, flash_algo.erase_chip, 0, 0, 0, 0)) {
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+
+    if (!swd_flash_syscall_exec(&flash_algo.sys_call_s, flash_algo.erase_chip, 0, 0, 0, 0)) {
         return ERROR_ERASE_ALL;
     }
 
-    return status;
+    return ERROR_SUCCESS;
+}
+
+// CRC-32 of size bytes of target flash at addr, computed on the target by
+// the algorithm's crc entry. Flash is only read, no Init() is needed.
+error_t target_flash_crc(uint32_t addr, uint32_t size, uint32_t *crc)
+{
+    error_t status;
+
+    status = target_flash_wait();
+
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+
+    if ((flash_algo.crc == 0) ||
+        !swd_flash_syscall_start(&flash_algo.sys_call_s, flash_algo.crc, addr, size, 0, 0) ||
+        !swd_flash_syscall_value(crc)) {
+        return ERROR_FAILURE;
+    }
+
+    return ERROR_SUCCESS;
 }
@@ -3,6 +3,13 @@
 
 #include <stdint.h>
 
+#include "flash_blob.h"
+
+
+// CRC-32 of the algorithm crc entry, as set up on the probe's CRC unit
+// (reflected, seed and result inverted)
+#define FLASH_CRC_ATTR      (CRC_WDATA_RVS | CRC_CHECKSUM_RVS | CRC_CHECKSUM_COM)
+
 
 typedef enum {
     /* Shared errors */
@@ -21,6 +28,7 @@ typedef enum {
     ERROR_ERASE_SECTOR,
     ERROR_ERASE_ALL,
     ERROR_WRITE,
+    ERROR_VERIFY,
 
     // Add new values here
 
@@ -28,11 +36,15 @@ typedef enum {
 } error_t;
 
 
-error_t target_flash_init(uint32_t flash_start, uint32_t func);
-error_t target_flash_uninit(uint32_t func);
+error_t target_flash_init(const program_target_t *algo, uint32_t start);
+error_t target_flash_uninit(void);
+const program_target_t *target_flash_algo(void);
+uint32_t target_flash_buffer(void);
+error_t target_flash_program_buffer(uint32_t addr, uint32_t size);
 error_t target_flash_program_page(uint32_t addr, const uint8_t *buf, uint32_t size);
 error_t target_flash_erase_sector(uint32_t addr);
 error_t target_flash_erase_chip(void);
+error_t target_flash_crc(uint32_t addr, uint32_t size, uint32_t *crc);
 
 
 #endif // __SWD_FLASH_H__
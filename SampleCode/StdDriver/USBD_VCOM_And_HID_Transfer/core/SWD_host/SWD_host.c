@@ -10,9 +10,8 @@
 #define SCB_AIRCR_PRIGROUP_Pos              8U                                            /*!< SCB AIRCR: PRIGROUP Position */
 #define SCB_AIRCR_PRIGROUP_Msk             (7UL << SCB_AIRCR_PRIGROUP_Pos)                /*!< SCB AIRCR: PRIGROUP Mask */
 
-uint32_t Flash_Page_Size = 4096;
-
-extern uint32_t Flash_Page_Size;
+// TAR auto-increment is only guaranteed within 1KB (ADIv5 minimum)
+#define TARGET_AUTO_INCREMENT_PAGE_SIZE (1024)
 
 
 #define NVIC_Addr    (0xe000e000)
@@ -33,6 +32,12 @@ extern uint32_t Flash_Page_Size;
 #define DHCSR 0xE000EDF0
 #define REGWnR (1 << 16)
 
+// Debug registers through the banked data registers (TAR = DBG_Addr)
+#define BD_DHCSR (AP_BD0)
+#define BD_DCRSR (AP_BD1)
+#define BD_DCRDR (AP_BD2)
+#define BD_DEMCR (AP_BD3)
+
 #define MAX_SWD_RETRY 10
 #define MAX_TIMEOUT   1000000  // Timeout for syscalls on target
 
@@ -49,6 +54,14 @@ typedef struct {
 
 static DAP_STATE dap_state;
 
+// Host AP state saved while the probe accesses the target in the background
+static struct {
+    uint8_t active;
+    uint32_t select;
+    uint32_t csw;
+    uint32_t tar;
+} bg_state;
+
 static uint8_t swd_read_core_register(uint32_t n, uint32_t *val);
 static uint8_t swd_write_core_register(uint32_t n, uint32_t val);
 
@@ -155,9 +168,31 @@ uint8_t swd_write_dp(uint8_t adr, uint32_t val)
 // Read access port register.
 uint8_t swd_read_ap(uint32_t adr, uint32_t *val)
 {
-    uint8_t tmp_in, ack;
+    if (!swd_read_ap_start(adr)) {
+        return 0;
+    }
+
+    return swd_read_ap_end(val);
+}
+
+// Post access port register read.
+// The result is returned by the next swd_read_ap_next() or swd_read_ap_end().
+uint8_t swd_read_ap_start(uint32_t adr)
+{
+    uint32_t apsel = adr & 0xff000000;
+    uint32_t bank_sel = adr & APBANKSEL;
+
+    if (!swd_write_dp(DP_SELECT, apsel | bank_sel)) {
+        return 0;
+    }
+
+    return (swd_transfer_retry(SWD_REG_AP | SWD_REG_R | SWD_REG_ADR(adr), NULL) == 0x01);
+}
+
+// Post next access port register read and return the result of the previous one.
+uint8_t swd_read_ap_next(uint32_t adr, uint32_t *val)
+{
     uint8_t tmp_out[4];
-    uint32_t tmp;
     uint32_t apsel = adr & 0xff000000;
     uint32_t bank_sel = adr & APBANKSEL;
 
@@ -165,22 +200,18 @@ uint8_t swd_read_ap(uint32_t adr, uint32_t *val)
         return 0;
     }
 
-    tmp_in = SWD_REG_AP | SWD_REG_R | SWD_REG_ADR(adr);
-    // first dummy read
-    swd_transfer_retry(tmp_in, (uint32_t *)tmp_out);
-    ack = swd_transfer_retry(tmp_in, (uint32_t *)tmp_out);
-	
-    *val = 0;
-    tmp = tmp_out[3];
-    *val |= (tmp << 24);
-    tmp = tmp_out[2];
-    *val |= (tmp << 16);
-    tmp = tmp_out[1];
-    *val |= (tmp << 8);
-    tmp = tmp_out[0];
-    *val |= (tmp << 0);
-	
-    return (ack == 0x01);
+    if (swd_transfer_retry(SWD_REG_AP | SWD_REG_R | SWD_REG_ADR(adr), (uint32_t *)tmp_out) != 0x01) {
+        return 0;
+    }
+
+    *val = tmp_out[0] | (tmp_out[1] << 8) | (tmp_out[2] << 16) | ((uint32_t)tmp_out[3] << 24);
+    return 1;
+}
+
+// Return the result of the last posted access port register read.
+uint8_t swd_read_ap_end(uint32_t *val)
+{
+    return swd_read_dp(DP_RDBUFF, val);
 }
 
 // Write access port register
@@ -406,36 +437,116 @@ static uint8_t swd_write_data(uint32_t address, uint32_t data)
     return 1;
 }
 
-// Read 8-bit byte from target memory.
-static uint8_t swd_read_byte(uint32_t addr, uint8_t *val)
+// Point TAR at the debug register window, DHCSR..DEMCR are then
+// accessed through BD0..BD3 without further TAR writes.
+static uint8_t swd_debug_window(void)
 {
-    uint32_t tmp;
+    uint8_t tmp_in[4];
 
-    if (!swd_write_ap(AP_CSW, CSW_VALUE | CSW_SIZE8)) {
+    if (!swd_write_ap(AP_CSW, CSW_VALUE | CSW_SIZE32)) {
         return 0;
     }
 
-    if (!swd_read_data(addr, &tmp)) {
+    int2array(tmp_in, DBG_Addr, 4);
+    return (swd_transfer_retry(SWD_REG_AP | SWD_REG_W | AP_TAR, (uint32_t *)tmp_in) == 0x01);
+}
+
+// Write debug register through the debug window.
+// The write is acknowledged by the next access.
+static uint8_t swd_write_debug(uint32_t bd, uint32_t val)
+{
+    uint8_t tmp_in[4];
+
+    if (!swd_write_dp(DP_SELECT, bd & APBANKSEL)) {
         return 0;
     }
 
-    *val = (uint8_t)(tmp >> ((addr & 0x03) << 3));
-    return 1;
+    int2array(tmp_in, val, 4);
+    return (swd_transfer_retry(SWD_REG_AP | SWD_REG_W | SWD_REG_ADR(bd), (uint32_t *)tmp_in) == 0x01);
 }
 
-// Write 8-bit byte to target memory.
-static uint8_t swd_write_byte(uint32_t addr, uint8_t val)
+// Poll DHCSR through the debug window until one of the mask bits is set.
+// Every poll is a single posted BD0 read.
+static uint8_t swd_wait_debug(uint32_t mask, uint32_t *val, uint32_t timeout)
 {
-    uint32_t tmp;
+    uint32_t i;
 
-    if (!swd_write_ap(AP_CSW, CSW_VALUE | CSW_SIZE8)) {
+    if (!swd_read_ap_start(BD_DHCSR)) {
         return 0;
     }
 
-    tmp = val << ((addr & 0x03) << 3);
+    for (i = 0; i < timeout; i++) {
+        if (!swd_read_ap_next(BD_DHCSR, val)) {
+            return 0;
+        }
 
-    if (!swd_write_data(addr, tmp)) {
-        return 0;
+        if (*val & mask) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Read or write the unaligned edge of a transfer (bytes within one word).
+// Halfword accesses are used where aligned and TAR is written only once,
+// the following accesses rely on the single auto-increment.
+static uint8_t swd_transfer_edge(uint32_t address, uint8_t *data, uint32_t size, uint8_t write)
+{
+    uint8_t tmp_in[4];
+    uint32_t n, val;
+    uint8_t tar = 0;
+
+    while (size > 0) {
+        n = (((address & 1) == 0) && (size > 1)) ? 2 : 1;
+
+        if (!swd_write_ap(AP_CSW, CSW_VALUE | ((n == 2) ? CSW_SIZE16 : CSW_SIZE8))) {
+            return 0;
+        }
+
+        if (!tar) {
+            int2array(tmp_in, address, 4);
+
+            if (swd_transfer_retry(SWD_REG_AP | SWD_REG_W | AP_TAR, (uint32_t *)tmp_in) != 0x01) {
+                return 0;
+            }
+
+            tar = 1;
+        }
+
+        if (write) {
+            val = data[0];
+
+            if (n == 2) {
+                val |= data[1] << 8;
+            }
+
+            int2array(tmp_in, val << ((address & 0x03) << 3), 4);
+
+            if (swd_transfer_retry(SWD_REG_AP | SWD_REG_W | AP_DRW, (uint32_t *)tmp_in) != 0x01) {
+                return 0;
+            }
+        } else {
+            if (!swd_read_ap(AP_DRW, &val)) {
+                return 0;
+            }
+
+            val >>= (address & 0x03) << 3;
+            data[0] = (uint8_t)val;
+
+            if (n == 2) {
+                data[1] = (uint8_t)(val >> 8);
+            }
+        }
+
+        address += n;
+        data += n;
+        size -= n;
+    }
+
+    if (write) {
+        // dummy read
+        return (swd_transfer_retry(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF), NULL) == 0x01);
     }
 
     return 1;
@@ -448,20 +559,26 @@ uint8_t swd_read_memory(uint32_t address, uint8_t *data, uint32_t size)
     uint32_t n;
 
     // Read bytes until word aligned
-    while ((size > 0) && (address & 0x3)) {
-        if (!swd_read_byte(address, data)) {
+    if ((size > 0) && (address & 0x3)) {
+        n = 4 - (address & 0x3);
+
+        if (n > size) {
+            n = size;
+        }
+
+        if (!swd_transfer_edge(address, data, n, 0)) {
             return 0;
         }
 
-        address++;
-        data++;
-        size--;
+        address += n;
+        data += n;
+        size -= n;
     }
 
     // Read word aligned blocks
     while (size > 3) {
         // Limit to auto increment page size
-        n = Flash_Page_Size - (address & (Flash_Page_Size - 1));
+        n = TARGET_AUTO_INCREMENT_PAGE_SIZE - (address & (TARGET_AUTO_INCREMENT_PAGE_SIZE - 1));
 
         if (size < n) {
             n = size & 0xFFFFFFFC; // Only count complete words remaining
@@ -477,14 +594,10 @@ uint8_t swd_read_memory(uint32_t address, uint8_t *data, uint32_t size)
     }
 
     // Read remaining bytes
-    while (size > 0) {
-        if (!swd_read_byte(address, data)) {
+    if (size > 0) {
+        if (!swd_transfer_edge(address, data, size, 0)) {
             return 0;
         }
-
-        address++;
-        data++;
-        size--;
     }
 
     return 1;
@@ -497,20 +610,26 @@ uint8_t swd_write_memory(uint32_t address, uint8_t *data, uint32_t size)
     uint32_t n = 0;
 
     // Write bytes until word aligned
-    while ((size > 0) && (address & 0x3)) {
-        if (!swd_write_byte(address, *data)) {
+    if ((size > 0) && (address & 0x3)) {
+        n = 4 - (address & 0x3);
+
+        if (n > size) {
+            n = size;
+        }
+
+        if (!swd_transfer_edge(address, data, n, 1)) {
             return 0;
         }
 
-        address++;
-        data++;
-        size--;
+        address += n;
+        data += n;
+        size -= n;
     }
 
     // Write word aligned blocks
     while (size > 3) {
         // Limit to auto increment page size
-        n = Flash_Page_Size - (address & (Flash_Page_Size - 1));
+        n = TARGET_AUTO_INCREMENT_PAGE_SIZE - (address & (TARGET_AUTO_INCREMENT_PAGE_SIZE - 1));
 
         if (size < n) {
             n = size & 0xFFFFFFFC; // Only count complete words remaining
@@ -526,25 +645,119 @@ uint8_t swd_write_memory(uint32_t address, uint8_t *data, uint32_t size)
     }
 
     // Write remaining bytes
+    if (size > 0) {
+        if (!swd_transfer_edge(address, data, size, 1)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Read or write target memory with 8-bit or 16-bit accesses only, for
+// peripheral registers that do not accept other widths. address and size
+// are multiples of access. TAR is written once per auto increment page
+// and reads are posted.
+static uint8_t swd_transfer_sized(uint32_t address, uint8_t *data, uint32_t size, uint32_t access, uint8_t write)
+{
+    uint8_t tmp_in[4];
+    uint32_t n, i, val;
+
+    if (!swd_write_ap(AP_CSW, CSW_VALUE | ((access == 2) ? CSW_SIZE16 : CSW_SIZE8))) {
+        return 0;
+    }
+
     while (size > 0) {
-        if (!swd_write_byte(address, *data)) {
+        n = TARGET_AUTO_INCREMENT_PAGE_SIZE - (address & (TARGET_AUTO_INCREMENT_PAGE_SIZE - 1));
+
+        if (n > size) {
+            n = size;
+        }
+
+        int2array(tmp_in, address, 4);
+
+        if (swd_transfer_retry(SWD_REG_AP | SWD_REG_W | AP_TAR, (uint32_t *)tmp_in) != 0x01) {
             return 0;
         }
 
-        address++;
-        data++;
-        size--;
+        if (write) {
+            for (i = 0; i < n; i += access) {
+                val = data[i];
+
+                if (access == 2) {
+                    val |= data[i + 1] << 8;
+                }
+
+                int2array(tmp_in, val << (((address + i) & 0x03) << 3), 4);
+
+                if (swd_transfer_retry(SWD_REG_AP | SWD_REG_W | AP_DRW, (uint32_t *)tmp_in) != 0x01) {
+                    return 0;
+                }
+            }
+        } else {
+            if (!swd_read_ap_start(AP_DRW)) {
+                return 0;
+            }
+
+            for (i = 0; i < n; i += access) {
+                if ((i + access) < n) {
+                    if (!swd_read_ap_next(AP_DRW, &val)) {
+                        return 0;
+                    }
+                } else if (!swd_read_ap_end(&val)) {
+                    return 0;
+                }
+
+                val >>= ((address + i) & 0x03) << 3;
+                data[i] = (uint8_t)val;
+
+                if (access == 2) {
+                    data[i + 1] = (uint8_t)(val >> 8);
+                }
+            }
+        }
+
+        address += n;
+        data += n;
+        size -= n;
+    }
+
+    if (write) {
+        // dummy read
+        return (swd_transfer_retry(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF), NULL) == 0x01);
     }
 
     return 1;
 }
 
+// Read target memory using accesses of one size (1, 2 or 4 bytes).
+// address and size are multiples of access.
+uint8_t swd_read_memory_sized(uint32_t address, uint8_t *data, uint32_t size, uint32_t access)
+{
+    if (access == 4) {
+        return swd_read_memory(address, data, size);    // Aligned: word blocks only
+    }
+
+    return swd_transfer_sized(address, data, size, access, 0);
+}
+
+// Write target memory using accesses of one size (1, 2 or 4 bytes).
+// address and size are multiples of access.
+uint8_t swd_write_memory_sized(uint32_t address, uint8_t *data, uint32_t size, uint32_t access)
+{
+    if (access == 4) {
+        return swd_write_memory(address, data, size);   // Aligned: word blocks only
+    }
+
+    return swd_transfer_sized(address, data, size, access, 1);
+}
+
 // Execute system call.
 static uint8_t swd_write_debug_state(DEBUG_STATE *state)
 {
     uint32_t i, status;
 
-    if (!swd_write_dp(DP_SELECT, 0)) {
+    if (!swd_debug_window()) {
         return 0;
     }
 
@@ -572,7 +785,7 @@ static uint8_t swd_write_debug_state(DEBUG_STATE *state)
         return 0;
     }
 
-    if (!swd_write_word(DBG_HCSR, DBGKEY | C_DEBUGEN)) {
+    if (!swd_write_debug(BD_DHCSR, DBGKEY | C_DEBUGEN)) {
         return 0;
     }
 
@@ -588,84 +801,97 @@ static uint8_t swd_write_debug_state(DEBUG_STATE *state)
     return 1;
 }
 
+// Core register access expects TAR at the debug window (swd_debug_window).
 static uint8_t swd_read_core_register(uint32_t n, uint32_t *val)
 {
-    int i = 0, timeout = 100;
-
-    if (!swd_write_word(DCRSR, n)) {
+    if (!swd_write_debug(BD_DCRSR, n)) {
         return 0;
     }
 
     // wait for S_REGRDY
-    for (i = 0; i < timeout; i++) {
-        if (!swd_read_word(DHCSR, val)) {
-            return 0;
-        }
-
-        if (*val & S_REGRDY) {
-            break;
-        }
-    }
-
-    if (i == timeout) {
+    if (!swd_wait_debug(S_REGRDY, val, 100)) {
         return 0;
     }
 
-    if (!swd_read_word(DCRDR, val)) {
+    // Drop the DHCSR read in flight and collect DCRDR
+    if (!swd_read_ap_next(BD_DCRDR, val)) {
         return 0;
     }
 
-    return 1;
+    return swd_read_ap_end(val);
 }
 
 static uint8_t swd_write_core_register(uint32_t n, uint32_t val)
 {
-    int i = 0, timeout = 100;
-
-    if (!swd_write_word(DCRDR, val)) {
+    if (!swd_write_debug(BD_DCRDR, val)) {
         return 0;
     }
 
-    if (!swd_write_word(DCRSR, n | REGWnR)) {
+    if (!swd_write_debug(BD_DCRSR, n | REGWnR)) {
         return 0;
     }
 
     // wait for S_REGRDY
-    for (i = 0; i < timeout; i++) {
-        if (!swd_read_word(DHCSR, &val)) {
+    return swd_wait_debug(S_REGRDY, &val, 100);
+}
+
+// Read core registers selected by mask (bit n = DCRSR REGSEL n).
+// Values are stored in ascending register order, the core must be halted.
+uint8_t swd_read_core_registers(uint32_t mask, uint32_t *val)
+{
+    uint32_t n;
+
+    if (!swd_debug_window()) {
+        return 0;
+    }
+
+    for (n = 0; mask != 0; n++, mask >>= 1) {
+        if ((mask & 1) && !swd_read_core_register(n, val++)) {
             return 0;
         }
+    }
 
-        if (val & S_REGRDY) {
-            return 1;
+    return 1;
+}
+
+// Write core registers selected by mask (bit n = DCRSR REGSEL n).
+// Values are taken in ascending register order, the core must be halted.
+uint8_t swd_write_core_registers(uint32_t mask, const uint32_t *val)
+{
+    uint32_t n;
+
+    if (!swd_debug_window()) {
+        return 0;
+    }
+
+    for (n = 0; mask != 0; n++, mask >>= 1) {
+        if ((mask & 1) && !swd_write_core_register(n, *val++)) {
+            return 0;
         }
     }
 
-    return 0;
+    return 1;
 }
 
 static uint8_t swd_wait_until_halted(void)
 {
     // Wait for target to stop
-    uint32_t val, i, timeout = MAX_TIMEOUT;
-
-    for (i = 0; i < timeout; i++) {
-        if (!swd_read_word(DBG_HCSR, &val)) {
-            return 0;
-        }
+    uint32_t val;
 
-        if (val & S_HALT) {
-            return 1;
-        }
+    if (!swd_debug_window()) {
+        return 0;
     }
 
-    return 0;
+    return swd_wait_debug(S_HALT, &val, MAX_TIMEOUT);
 }
 
-uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
+// Start a flash algorithm function on the target, the core runs until it
+// returns to the breakpoint. The target is free for memory accesses until
+// swd_flash_syscall_result() collects the result.
+uint8_t swd_flash_syscall_start(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
 {
     DEBUG_STATE state = {{0}, 0};
-    // Call flash algorithm function on target and wait for result.
+
     state.r[0]     = arg1;                   // R0: Argument 1
     state.r[1]     = arg2;                   // R1: Argument 2
     state.r[2]     = arg3;                   // R2: Argument 3
@@ -676,26 +902,46 @@ uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t e
     state.r[15]    = entry;                        // PC: Entry Point
     state.xpsr     = 0x01000000;          // xPSR: T = 1, ISR = 0
 
-    if (!swd_write_debug_state(&state)) {
-        return 0;
-    }
+    return swd_write_debug_state(&state);
+}
 
+// Wait for the started flash algorithm function to return its R0.
+uint8_t swd_flash_syscall_value(uint32_t *val)
+{
     if (!swd_wait_until_halted()) {
         return 0;
     }
 
-    if (!swd_read_core_register(0, &state.r[0])) {
+    return swd_read_core_register(0, val);
+}
+
+// Wait for the started flash algorithm function to return.
+uint8_t swd_flash_syscall_result(void)
+{
+    uint32_t r0;
+
+    if (!swd_flash_syscall_value(&r0)) {
         return 0;
     }
 
     // Flash functions return 0 if successful.
-    if (state.r[0] != 0) {
+    if (r0 != 0) {
         return 0;
     }
 
     return 1;
 }
 
+// Call flash algorithm function on target and wait for result.
+uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
+{
+    if (!swd_flash_syscall_start(sysCallParam, entry, arg1, arg2, arg3, arg4)) {
+        return 0;
+    }
+
+    return swd_flash_syscall_result();
+}
+
 // SWD Reset
 static uint8_t swd_reset(void)
 {
@@ -760,6 +1006,53 @@ static uint8_t JTAG2SWD()
     return 1;
 }
 
+// Forget cached SELECT and CSW values.
+// Required before host driven DAP_Transfer commands and SWD_host calls are mixed.
+void swd_invalidate_state(void)
+{
+    dap_state.select = 0xffffffff;
+    dap_state.csw = 0xffffffff;
+}
+
+// Start background target access between host commands.
+// SELECT (as last written), CSW and TAR of the host are saved once and kept
+// until swd_background_end(), so consecutive background accesses are cheap.
+uint8_t swd_background_begin(void)
+{
+    if (bg_state.active) {
+        return 1;
+    }
+
+    bg_state.select = DAP_Data.dp_select;
+    swd_invalidate_state();
+
+    if (!swd_read_ap(AP_CSW, &bg_state.csw) || !swd_read_ap(AP_TAR, &bg_state.tar)) {
+        swd_write_dp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
+        swd_write_dp(DP_SELECT, bg_state.select);
+        return 0;
+    }
+
+    dap_state.csw = bg_state.csw;
+    bg_state.active = 1;
+    return 1;
+}
+
+// End background target access and restore the host AP state.
+// Called before every host command.
+void swd_background_end(void)
+{
+    if (!bg_state.active) {
+        return;
+    }
+
+    bg_state.active = 0;
+    swd_write_ap(AP_CSW, bg_state.csw);
+    swd_write_ap(AP_TAR, bg_state.tar);
+    dap_state.select = ~bg_state.select;
+    swd_write_dp(DP_SELECT, bg_state.select);
+    swd_invalidate_state();
+}
+
 uint8_t swd_init_debug(void)
 {
     uint32_t tmp = 0;
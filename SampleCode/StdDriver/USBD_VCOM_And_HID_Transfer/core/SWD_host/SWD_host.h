@@ -24,9 +24,22 @@ uint8_t swd_read_dp(uint8_t adr, uint32_t *val);
 uint8_t swd_write_dp(uint8_t adr, uint32_t val);
 uint8_t swd_read_ap(uint32_t adr, uint32_t *val);
 uint8_t swd_write_ap(uint32_t adr, uint32_t val);
+uint8_t swd_read_ap_start(uint32_t adr);
+uint8_t swd_read_ap_next(uint32_t adr, uint32_t *val);
+uint8_t swd_read_ap_end(uint32_t *val);
 uint8_t swd_read_memory(uint32_t address, uint8_t *data, uint32_t size);
 uint8_t swd_write_memory(uint32_t address, uint8_t *data, uint32_t size);
+uint8_t swd_read_memory_sized(uint32_t address, uint8_t *data, uint32_t size, uint32_t access);
+uint8_t swd_write_memory_sized(uint32_t address, uint8_t *data, uint32_t size, uint32_t access);
+uint8_t swd_read_core_registers(uint32_t mask, uint32_t *val);
+uint8_t swd_write_core_registers(uint32_t mask, const uint32_t *val);
+void swd_invalidate_state(void);
+uint8_t swd_background_begin(void);
+void swd_background_end(void);
 uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
+uint8_t swd_flash_syscall_start(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
+uint8_t swd_flash_syscall_value(uint32_t *val);
+uint8_t swd_flash_syscall_result(void);
 void swd_set_target_reset(uint8_t asserted);
 uint8_t swd_set_target_state_hw(TARGET_RESET_STATE state);
 uint8_t swd_set_target_state_sw(TARGET_RESET_STATE state);
@@ -0,0 +1,231 @@
+/**
+ * @file    SWD_profile.c
+ * @brief   Statistical PC-sampling profiler reading DWT_PCSR over SWD
+ *
+ * A timer interrupt paces the profiler. From the main loop, between host
+ * commands and inside the background AP save/restore, each period reads
+ * DWT_PCSR from the running core and counts the PC into a histogram of
+ * power-of-two sized buckets starting at a configurable base address.
+ * The host downloads the histogram in packet-sized slices with
+ * ID_DAP_ProfileRead.
+ */
+#include "swd_host.h"
+#include "SWD_profile.h"
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "debug_cm.h"
+
+#if (PROFILE_BUCKETS != 0U)
+
+#ifndef PROFILE_TIMER
+#define PROFILE_TIMER            TIMER2
+#define PROFILE_TIMER_IRQn       TMR2_IRQn
+#define PROFILE_TIMER_IRQHandler TMR2_IRQHandler
+#endif
+
+#define DBG_Addr                (0xe000edf0)
+
+#define PCSR_INVALID            0xFFFFFFFF      // Core halted or PC sampling not implemented
+
+#define PROFILE_PERIOD_MIN      10U             // Shortest sample period in us
+#define PROFILE_SHIFT_MAX       24U             // Largest bucket size (2^n bytes)
+#define PROFILE_READ_MAX        ((DAP_PACKET_SIZE - 15U) / 2U)
+
+static uint16_t ProfileBucket[PROFILE_BUCKETS];    // PC histogram (saturating)
+
+static struct {
+    uint8_t enable;                     // Profiler running
+    uint8_t shift;                      // Bucket size is 2^shift bytes
+    uint32_t base;                      // Address of bucket 0
+    volatile uint32_t ticks;            // Timer periods elapsed
+    uint32_t done;                      // Timer periods sampled
+    uint32_t total;                     // Samples taken
+    uint32_t outside;                   // Samples outside the histogram range
+    uint32_t invalid;                   // Halted core or failed reads
+} profile;
+
+
+void PROFILE_TIMER_IRQHandler(void)
+{
+    TIMER_ClearIntFlag(PROFILE_TIMER);
+    profile.ticks++;
+}
+
+static void profile_stop(void)
+{
+    TIMER_Stop(PROFILE_TIMER);
+    TIMER_DisableInt(PROFILE_TIMER);
+    NVIC_DisableIRQ(PROFILE_TIMER_IRQn);
+    TIMER_ClearIntFlag(PROFILE_TIMER);
+    profile.enable = 0;
+}
+
+static void profile_start(uint32_t period)
+{
+    PROFILE_TIMER->CTL = TIMER_PERIODIC_MODE;
+    PROFILE_TIMER->CMP = period * (TIMESTAMP_CLOCK / 1000000U);
+    TIMER_ClearIntFlag(PROFILE_TIMER);
+    TIMER_EnableInt(PROFILE_TIMER);
+    NVIC_EnableIRQ(PROFILE_TIMER_IRQn);
+    profile.ticks = 0;
+    profile.done = 0;
+    profile.enable = 1;
+    TIMER_Start(PROFILE_TIMER);
+}
+
+// Take one PC sample when a period elapsed, called from the main loop.
+void SWD_Profile_Process(void)
+{
+    uint32_t pc, index;
+
+    if (!profile.enable || (profile.ticks == profile.done) ||
+        (DAP_Data.debug_port != DAP_PORT_SWD)) {
+        return;
+    }
+
+    profile.done = profile.ticks;
+    profile.total++;
+
+    if (!swd_background_begin()) {
+        profile.invalid++;
+        return;
+    }
+
+    if (!swd_read_word(DWT_PCSR, &pc)) {
+        swd_write_dp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
+        profile.invalid++;
+        return;
+    }
+
+    if (pc == PCSR_INVALID) {
+        profile.invalid++;
+        return;
+    }
+
+    index = (pc - profile.base) >> profile.shift;
+
+    if ((pc < profile.base) || (index >= PROFILE_BUCKETS)) {
+        profile.outside++;
+        return;
+    }
+
+    if (ProfileBucket[index] != 0xFFFF) {
+        ProfileBucket[index]++;
+    }
+}
+
+// Process Profile command and prepare response
+//   request:  [0] control (PROFILE_CONTROL_*)
+//             [1..2] sample period in us
+//             [3..6] address of bucket 0
+//             [7] bucket size as power of two (bytes = 2^n)
+//   response: status, number of buckets (2 bytes)
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWD_Profile_Config(const uint8_t *request, uint8_t *response)
+{
+    uint32_t period, demcr, i;
+
+    period = request[1] | (request[2] << 8);
+
+    profile_stop();
+
+    response[0] = DAP_OK;
+    response[1] = (uint8_t)(PROFILE_BUCKETS >> 0);
+    response[2] = (uint8_t)(PROFILE_BUCKETS >> 8);
+
+    if (request[0] & PROFILE_CONTROL_CLEAR) {
+        for (i = 0; i < PROFILE_BUCKETS; i++) {
+            ProfileBucket[i] = 0;
+        }
+
+        profile.total = 0;
+        profile.outside = 0;
+        profile.invalid = 0;
+    }
+
+    if ((request[0] & PROFILE_CONTROL_ENABLE) == 0) {
+        return ((8U << 16) | 3U);
+    }
+
+    if ((period < PROFILE_PERIOD_MIN) || (request[7] > PROFILE_SHIFT_MAX) ||
+        (DAP_Data.debug_port != DAP_PORT_SWD)) {
+        response[0] = DAP_ERROR;
+        return ((8U << 16) | 3U);
+    }
+
+    // The host may have moved SELECT/CSW with DAP_Transfer
+    swd_invalidate_state();
+
+    // DWT_PCSR reads need the DWT enabled
+    if (!swd_read_word(DBG_EMCR, &demcr) ||
+        (((demcr & TRCENA) == 0) && !swd_write_word(DBG_EMCR, demcr | TRCENA))) {
+        response[0] = DAP_ERROR;
+        return ((8U << 16) | 3U);
+    }
+
+    profile.base = request[3] | (request[4] << 8) | (request[5] << 16) | ((uint32_t)request[6] << 24);
+    profile.shift = request[7];
+    profile_start(period);
+
+    return ((8U << 16) | 3U);
+}
+
+// Process Profile Read command and prepare response
+//   request:  [0..1] first bucket
+//             [2] flags (PROFILE_READ_*)
+//   response: status, samples taken (4 bytes), samples outside range
+//             (4 bytes), invalid samples (4 bytes), bucket count,
+//             bucket counts (2 bytes each)
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWD_Profile_Read(const uint8_t *request, uint8_t *response)
+{
+    uint32_t first, count, i;
+    uint8_t *data;
+
+    first = request[0] | (request[1] << 8);
+
+    response[0] = DAP_OK;
+    response[1] = (uint8_t)(profile.total >> 0);
+    response[2] = (uint8_t)(profile.total >> 8);
+    response[3] = (uint8_t)(profile.total >> 16);
+    response[4] = (uint8_t)(profile.total >> 24);
+    response[5] = (uint8_t)(profile.outside >> 0);
+    response[6] = (uint8_t)(profile.outside >> 8);
+    response[7] = (uint8_t)(profile.outside >> 16);
+    response[8] = (uint8_t)(profile.outside >> 24);
+    response[9] = (uint8_t)(profile.invalid >> 0);
+    response[10] = (uint8_t)(profile.invalid >> 8);
+    response[11] = (uint8_t)(profile.invalid >> 16);
+    response[12] = (uint8_t)(profile.invalid >> 24);
+
+    if (first >= PROFILE_BUCKETS) {
+        response[0] = DAP_ERROR;
+        response[13] = 0;
+        return ((3U << 16) | 14U);
+    }
+
+    count = PROFILE_BUCKETS - first;
+
+    if (count > PROFILE_READ_MAX) {
+        count = PROFILE_READ_MAX;
+    }
+
+    response[13] = (uint8_t)count;
+    data = &response[14];
+
+    for (i = first; i < (first + count); i++) {
+        *data++ = (uint8_t)(ProfileBucket[i] >> 0);
+        *data++ = (uint8_t)(ProfileBucket[i] >> 8);
+
+        if (request[2] & PROFILE_READ_CLEAR) {
+            ProfileBucket[i] = 0;
+        }
+    }
+
+    return ((3U << 16) | (14U + (count * 2U)));
+}
+
+#endif
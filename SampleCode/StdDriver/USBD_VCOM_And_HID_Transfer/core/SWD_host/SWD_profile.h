@@ -0,0 +1,20 @@
+#ifndef __SWD_PROFILE_H__
+#define __SWD_PROFILE_H__
+
+#include <stdint.h>
+
+
+// Profile control flags
+#define PROFILE_CONTROL_ENABLE  0x01    // Start sampling (stop when clear)
+#define PROFILE_CONTROL_CLEAR   0x02    // Clear histogram and counters
+
+// Profile read flags
+#define PROFILE_READ_CLEAR      0x01    // Clear the returned buckets
+
+
+void SWD_Profile_Process(void);
+uint32_t SWD_Profile_Config(const uint8_t *request, uint8_t *response);
+uint32_t SWD_Profile_Read(const uint8_t *request, uint8_t *response);
+
+
+#endif // __SWD_PROFILE_H__
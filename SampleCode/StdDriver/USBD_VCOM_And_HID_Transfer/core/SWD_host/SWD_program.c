@@ -0,0 +1,473 @@
+/**
+ * @file    SWD_program.c
+ * @brief   Streamed flash programming session driven by vendor commands
+ *
+ * The host starts a session with the flash algorithm descriptor (the
+ * algorithm itself is already in target RAM), then streams the image in
+ * ascending address order. Data goes straight into the algorithm's
+ * program buffer in target RAM; a full buffer, a jump to another page or
+ * the end of the session programs it, after the erase planner (SWD_erase.c)
+ * has erased the sectors it covers. Before the data the host may send the
+ * sector map and the image ranges to plan with. Gaps inside a page are padded
+ * with the erased value. With a second program buffer the next page is
+ * uploaded while the target is still programming the previous one. In
+ * incremental mode the probe's CRC unit checksums each page as it streams
+ * in and the algorithm's crc entry checksums the flash it would replace;
+ * pages that match are neither erased nor programmed. The host only sees
+ * status and progress.
+ */
+#include "swd_host.h"
+#include "SWD_flash.h"
+#include "SWD_erase.h"
+#include "SWD_target.h"
+#include "SWD_program.h"
+
+#include "DAP_config.h"
+#include "DAP.h"
+
+#define PROGRAM_ERASED      0xFF        // Erased flash value used for padding
+#define PROGRAM_DATA_MAX    (DAP_PACKET_SIZE - 6U)
+#define PROGRAM_PLAN_MAX    ((DAP_PACKET_SIZE - 3U) / 8U)
+
+static const uint8_t PadBuf[32] = {
+    PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED,
+    PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED,
+    PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED,
+    PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED,
+    PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED,
+    PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED,
+    PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED,
+    PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED, PROGRAM_ERASED,
+};
+
+static struct {
+    uint8_t active;                     // Session started
+    uint8_t open;                       // Program buffer holds a page
+    uint8_t error;                      // error_t of the first failure
+    uint8_t skip;                       // Skip pages already in flash
+    uint8_t erase;                      // erase_plan_begin() mode
+    uint8_t planned;                    // Erase plan started
+    uint8_t mapped;                     // Host sent a sector map
+    uint32_t page;                      // Address of the page in the buffer
+    uint32_t fill;                      // Page bytes written to the buffer
+    uint32_t done;                      // End of the last flushed page
+    uint32_t count;                     // Image bytes programmed
+    uint32_t skipped;                   // Bytes in pages skipped as unchanged
+} prog;
+
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Add page bytes to the probe CRC in incremental mode.
+static void program_crc(const uint8_t *data, uint32_t n)
+{
+    if (!prog.skip) {
+        return;
+    }
+
+    while (n--) {
+        CRC_WRITE_DATA(*data++);
+    }
+}
+
+// Fill the program buffer with the erased value from offset to end.
+static error_t program_pad(uint32_t offset, uint32_t end)
+{
+    uint32_t n;
+
+    while (offset < end) {
+        n = end - offset;
+
+        if (n > sizeof(PadBuf)) {
+            n = sizeof(PadBuf);
+        }
+
+        program_crc(PadBuf, n);
+
+        if (!swd_write_memory(target_flash_buffer() + offset, (uint8_t *)PadBuf, n)) {
+            return ERROR_ALGO_DATA_SEQ;
+        }
+
+        offset += n;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+// Program the page in the buffer, unless flash already holds it.
+static error_t program_flush(void)
+{
+    uint32_t size = target_flash_algo()->program_buffer_size;
+    uint32_t crc;
+    error_t status;
+
+    if (!prog.open) {
+        return ERROR_SUCCESS;
+    }
+
+    prog.open = 0;
+    prog.done = prog.page + size;
+
+    status = program_pad(prog.fill, size);
+
+    if ((status == ERROR_SUCCESS) && prog.skip) {
+        status = target_flash_crc(prog.page, size, &crc);
+
+        if ((status == ERROR_SUCCESS) && (crc == CRC_GetChecksum())) {
+            prog.skipped += size;
+            return ERROR_SUCCESS;
+        }
+    }
+
+    if ((status == ERROR_SUCCESS) && !prog.planned) {
+        prog.planned = 1;
+        status = erase_plan_begin(prog.erase);
+    }
+
+    if (status == ERROR_SUCCESS) {
+        status = erase_plan_erase(prog.page, prog.page + size);
+    }
+
+    if (status == ERROR_SUCCESS) {
+        status = target_flash_program_buffer(prog.page, size);
+    }
+
+    return status;
+}
+
+// Add image data, programming completed pages.
+static error_t program_data(uint32_t addr, const uint8_t *data, uint32_t count)
+{
+    uint32_t size = target_flash_algo()->program_buffer_size;
+    uint32_t n;
+    error_t status;
+
+    if (addr < prog.done) {
+        return ERROR_ALGO_DATA_SEQ;         // Page already programmed
+    }
+
+    while (count > 0) {
+        if (prog.open && (addr >= (prog.page + size))) {
+            status = program_flush();
+
+            if (status != ERROR_SUCCESS) {
+                return status;
+            }
+        }
+
+        if (!prog.open) {
+            prog.page = addr - (addr % size);
+            prog.fill = 0;
+            prog.open = 1;
+
+            if (prog.skip) {
+                CRC_Open(CRC_32, FLASH_CRC_ATTR, 0xFFFFFFFF, CRC_WDATA_8);
+            }
+        }
+
+        if (addr < (prog.page + prog.fill)) {
+            return ERROR_ALGO_DATA_SEQ;     // Data must be in ascending order
+        }
+
+        status = program_pad(prog.fill, addr - prog.page);
+
+        if (status != ERROR_SUCCESS) {
+            return status;
+        }
+
+        n = prog.page + size - addr;
+
+        if (n > count) {
+            n = count;
+        }
+
+        program_crc(data, n);
+
+        if (!swd_write_memory(target_flash_buffer() + (addr - prog.page), (uint8_t *)data, n)) {
+            return ERROR_ALGO_DATA_SEQ;
+        }
+
+        prog.fill = addr - prog.page + n;
+        prog.count += n;
+        addr += n;
+        data += n;
+        count -= n;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+// Common response: status, error_t, image bytes programmed (4 bytes),
+//                  bytes skipped as unchanged (4 bytes)
+static uint32_t program_response(uint8_t *response)
+{
+    response[0] = (prog.error == ERROR_SUCCESS) ? DAP_OK : DAP_ERROR;
+    response[1] = prog.error;
+    response[2] = (uint8_t)(prog.count >> 0);
+    response[3] = (uint8_t)(prog.count >> 8);
+    response[4] = (uint8_t)(prog.count >> 16);
+    response[5] = (uint8_t)(prog.count >> 24);
+    response[6] = (uint8_t)(prog.skipped >> 0);
+    response[7] = (uint8_t)(prog.skipped >> 8);
+    response[8] = (uint8_t)(prog.skipped >> 16);
+    response[9] = (uint8_t)(prog.skipped >> 24);
+    return 10U;
+}
+
+// Start a session on the connected target, used by Flash Start and by
+// standalone programming.
+//   algo:        flash algorithm, ignored with PROGRAM_CONTROL_REGISTRY
+//   start:       flash start address (Init argument)
+//   sector_size: uniform sector size for erase ahead (0 = no erase)
+//   control:     PROGRAM_CONTROL_* flags
+//   return:      error_t of the session
+error_t SWD_Program_Begin(const program_target_t *algo, uint32_t start, uint32_t sector_size, uint8_t control)
+{
+    const flash_target_t *target;
+    error_t status;
+
+    prog.active = 0;
+    prog.open = 0;
+    prog.done = 0;
+    prog.count = 0;
+    prog.skipped = 0;
+    prog.skip = (control & PROGRAM_CONTROL_SKIP_SAME) ? 1 : 0;
+    prog.planned = 0;
+    prog.mapped = 0;
+
+    if (control & PROGRAM_CONTROL_ERASE_CHIP) {
+        prog.erase = ERASE_PLAN_CHIP;
+    } else if (control & PROGRAM_CONTROL_ERASE_AUTO) {
+        prog.erase = ERASE_PLAN_AUTO;
+    } else {
+        prog.erase = ERASE_PLAN_SECTOR;
+    }
+
+    erase_plan_init();
+
+    if (sector_size != 0) {
+        erase_plan_region(0, sector_size);
+    }
+
+    // The host may have changed SELECT/CSW through DAP_Transfer
+    swd_invalidate_state();
+
+    if (control & PROGRAM_CONTROL_REGISTRY) {
+        if (!target_flash_identify()) {
+            prog.error = ERROR_FAILURE;
+            return ERROR_FAILURE;
+        }
+
+        target = target_flash_target();
+        algo = target->algo;
+        start = target->flash_start;
+        erase_plan_map(target->sectors, target->sector_count);
+    }
+
+    // A skipped page must not share a sector with an erased one
+    if ((algo->program_buffer_size == 0) ||
+        (prog.skip && ((algo->crc == 0) || (prog.erase != ERASE_PLAN_SECTOR) ||
+                       !erase_plan_fits(algo->program_buffer_size)))) {
+        prog.error = ERROR_FAILURE;
+        return ERROR_FAILURE;
+    }
+
+    status = target_flash_init(algo, start);
+
+    if ((status == ERROR_SUCCESS) && (prog.erase == ERASE_PLAN_CHIP)) {
+        prog.planned = 1;
+        status = erase_plan_begin(ERASE_PLAN_CHIP);
+    }
+
+    prog.error = status;
+    prog.active = (status == ERROR_SUCCESS) ? 1 : 0;
+
+    return status;
+}
+
+// Add image data to the session, in ascending address order.
+error_t SWD_Program_Write(uint32_t addr, const uint8_t *data, uint32_t count)
+{
+    if (!prog.active) {
+        if (prog.error == ERROR_SUCCESS) {
+            prog.error = ERROR_ALGO_DATA_SEQ;
+        }
+    } else if (prog.error == ERROR_SUCCESS) {
+        swd_invalidate_state();
+        prog.error = program_data(addr, data, count);
+    }
+
+    return (error_t)prog.error;
+}
+
+// Program the last page and uninitialise the algorithm.
+error_t SWD_Program_Finish(void)
+{
+    error_t status;
+
+    if (prog.active) {
+        swd_invalidate_state();
+
+        if (prog.error == ERROR_SUCCESS) {
+            prog.error = program_flush();
+        }
+
+        status = target_flash_uninit();
+
+        if (prog.error == ERROR_SUCCESS) {
+            prog.error = status;
+        }
+
+        prog.active = 0;
+    } else if (prog.error == ERROR_SUCCESS) {
+        prog.error = ERROR_ALGO_DATA_SEQ;
+    }
+
+    return (error_t)prog.error;
+}
+
+// Process Flash Start command and prepare response
+//   request:  [0] control (PROGRAM_CONTROL_*)
+//             [1..4] flash start address (Init argument)
+//             [5..8] uniform sector size for erase ahead (0 = no erase)
+//             [9..48] algorithm: Init, UnInit, EraseChip, EraseSector,
+//                     ProgramPage, breakpoint, static base, stack pointer,
+//                     program buffer, program buffer size (4 bytes each)
+//             With PROGRAM_CONTROL_EXTENDED only:
+//             [49..52] second program buffer (0 = none)
+//             [53..56] crc entry, required by PROGRAM_CONTROL_SKIP_SAME (0 = none)
+//             With PROGRAM_CONTROL_REGISTRY the algorithm, flash start and
+//             sector map come from the registry entry matching the target.
+//   response: status, error, bytes programmed (4 bytes), bytes skipped (4 bytes)
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWD_Program_Start(const uint8_t *request, uint8_t *response)
+{
+    program_target_t algo;
+    uint32_t length;
+
+    algo.init = get_u32(&request[9]);
+    algo.uninit = get_u32(&request[13]);
+    algo.erase_chip = get_u32(&request[17]);
+    algo.erase_sector = get_u32(&request[21]);
+    algo.program_page = get_u32(&request[25]);
+    algo.sys_call_s.breakpoint = get_u32(&request[29]);
+    algo.sys_call_s.static_base = get_u32(&request[33]);
+    algo.sys_call_s.stack_pointer = get_u32(&request[37]);
+    algo.program_buffer = get_u32(&request[41]);
+    algo.program_buffer_size = get_u32(&request[45]);
+    algo.program_buffer_2 = 0;
+    algo.crc = 0;
+    length = 49U;
+
+    if (request[0] & PROGRAM_CONTROL_EXTENDED) {
+        algo.program_buffer_2 = get_u32(&request[49]);
+        algo.crc = get_u32(&request[53]);
+        length = 57U;
+    }
+
+    algo.algo_start = 0;
+    algo.algo_size = 0;
+    algo.algo_blob = 0;
+
+    if (DAP_Data.debug_port != DAP_PORT_SWD) {
+        prog.active = 0;
+        prog.error = ERROR_FAILURE;
+    } else {
+        SWD_Program_Begin(&algo, get_u32(&request[1]), get_u32(&request[5]), request[0]);
+    }
+
+    return ((length << 16) | program_response(response));
+}
+
+// Process Flash Plan command and prepare response
+//   The first sector map of a session replaces the Flash Start sector size.
+//   Sector map regions and image ranges must be sent in ascending order,
+//   the map before the ranges and both before the first page is programmed.
+//   request:  [0] entry type (PROGRAM_PLAN_*)
+//             [1] number of entries
+//             entries: start address, size (4 bytes each)
+//   response: status, sectors touched by the ranges so far (4 bytes)
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWD_Program_Plan(const uint8_t *request, uint8_t *response)
+{
+    uint32_t count = request[1];
+    uint32_t sectors, i;
+    uint8_t ok;
+
+    if (count > PROGRAM_PLAN_MAX) {
+        count = PROGRAM_PLAN_MAX;
+    }
+
+    ok = (prog.active && !prog.planned && (prog.error == ERROR_SUCCESS) &&
+          (count == request[1])) ? 1 : 0;
+
+    if (ok && (request[0] == PROGRAM_PLAN_MAP)) {
+        if (!prog.mapped) {
+            erase_plan_init();
+            prog.mapped = 1;
+        }
+
+        for (i = 0; ok && (i < count); i++) {
+            ok = erase_plan_region(get_u32(&request[2 + i * 8]), get_u32(&request[6 + i * 8]));
+        }
+
+        if (prog.skip && !erase_plan_fits(target_flash_algo()->program_buffer_size)) {
+            ok = 0;
+        }
+    } else if (ok && (request[0] == PROGRAM_PLAN_RANGES)) {
+        for (i = 0; ok && (i < count); i++) {
+            ok = erase_plan_range(get_u32(&request[2 + i * 8]), get_u32(&request[6 + i * 8]));
+        }
+    } else {
+        ok = 0;
+    }
+
+    sectors = erase_plan_sectors();
+
+    response[0] = ok ? DAP_OK : DAP_ERROR;
+    response[1] = (uint8_t)(sectors >> 0);
+    response[2] = (uint8_t)(sectors >> 8);
+    response[3] = (uint8_t)(sectors >> 16);
+    response[4] = (uint8_t)(sectors >> 24);
+
+    // Real request length, count may have been clamped
+    return (((2U + request[1] * 8U) << 16) | 5U);
+}
+
+// Process Flash Data command and prepare response
+//   request:  [0..3] address, [4] number of bytes, data
+//   response: status, error, bytes programmed (4 bytes), bytes skipped (4 bytes)
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWD_Program_Data(const uint8_t *request, uint8_t *response)
+{
+    uint32_t count = request[4];
+
+    if (count > PROGRAM_DATA_MAX) {
+        count = PROGRAM_DATA_MAX;
+        prog.error = ERROR_ALGO_DATA_SEQ;
+    }
+
+    SWD_Program_Write(get_u32(&request[0]), &request[5], count);
+
+    return (((5U + request[4]) << 16) | program_response(response));
+}
+
+// Process Flash End command and prepare response
+//   Programs the last page and uninitialises the algorithm.
+//   response: status, error, bytes programmed (4 bytes), bytes skipped (4 bytes)
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWD_Program_End(const uint8_t *request, uint8_t *response)
+{
+    (void)request;
+
+    SWD_Program_Finish();
+
+    return ((0U << 16) | program_response(response));
+}
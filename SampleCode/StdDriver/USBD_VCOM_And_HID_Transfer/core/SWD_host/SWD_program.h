@@ -0,0 +1,31 @@
+#ifndef __SWD_PROGRAM_H__
+#define __SWD_PROGRAM_H__
+
+#include <stdint.h>
+
+#include "SWD_flash.h"
+
+
+// Flash Start control flags
+#define PROGRAM_CONTROL_ERASE_CHIP  0x01    // Erase chip instead of sectors ahead of the data
+#define PROGRAM_CONTROL_SKIP_SAME   0x02    // Skip pages whose flash CRC matches the data
+#define PROGRAM_CONTROL_ERASE_AUTO  0x04    // Chip erase if the erase plan estimates it faster
+#define PROGRAM_CONTROL_REGISTRY    0x08    // Use the registry algorithm matching the target
+#define PROGRAM_CONTROL_EXTENDED    0x10    // Request carries the second program buffer and crc entry
+
+// Flash Plan entry types
+#define PROGRAM_PLAN_MAP            0x00    // Sector map regions (start, sector size)
+#define PROGRAM_PLAN_RANGES         0x01    // Image ranges (start, size)
+
+
+error_t SWD_Program_Begin(const program_target_t *algo, uint32_t start, uint32_t sector_size, uint8_t control);
+error_t SWD_Program_Write(uint32_t addr, const uint8_t *data, uint32_t count);
+error_t SWD_Program_Finish(void);
+
+uint32_t SWD_Program_Start(const uint8_t *request, uint8_t *response);
+uint32_t SWD_Program_Plan(const uint8_t *request, uint8_t *response);
+uint32_t SWD_Program_Data(const uint8_t *request, uint8_t *response);
+uint32_t SWD_Program_End(const uint8_t *request, uint8_t *response);
+
+
+#endif // __SWD_PROGRAM_H__
@@ -0,0 +1,257 @@
+/**
+ * @file    SWD_sample.c
+ * @brief   Live target memory sampler with timestamped bulk stream
+ *
+ * A timer interrupt paces the sampler. The reads themselves run from the
+ * main loop between host commands, reusing the background AP save/restore
+ * of the halt watcher, so the core keeps running and the host's SELECT,
+ * CSW and TAR are left untouched. Every sample becomes one fixed size
+ * record in a ring buffer that streams to the host over the bulk IN
+ * endpoint shared with SWO trace, which has priority:
+ *
+ *   [0]     flags (SAMPLE_FLAG_*)
+ *   [1..4]  timestamp (TIMESTAMP_CLOCK ticks)
+ *   [5..]   sampled data, in configuration order, little endian
+ */
+#include <string.h>
+
+#include "swd_host.h"
+#include "SWD_sample.h"
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "debug_cm.h"
+
+#if ((SAMPLE_BUFFER_SIZE != 0U) && (SWO_STREAM != 0))
+
+#ifndef SAMPLE_TIMER
+#define SAMPLE_TIMER            TIMER1
+#define SAMPLE_TIMER_IRQn       TMR1_IRQn
+#define SAMPLE_TIMER_IRQHandler TMR1_IRQHandler
+#endif
+
+#define SAMPLE_PERIOD_MIN       10U     // Shortest sample period in us
+#define SAMPLE_HEADER_SIZE      5U      // Record flags and timestamp
+
+static uint8_t SampleBuf[SAMPLE_BUFFER_SIZE];   // Record ring buffer (must be 2^n)
+
+static struct {
+    uint8_t enable;                     // Sampler running
+    uint8_t count;                      // Number of sampled addresses
+    uint8_t size;                       // Record size in bytes
+    uint8_t flags;                      // Flags for the next record
+    uint8_t entry_size[SAMPLE_ENTRY_MAX];
+    uint32_t entry_addr[SAMPLE_ENTRY_MAX];
+    volatile uint32_t ticks;            // Timer periods elapsed
+    uint32_t done;                      // Timer periods sampled
+    uint32_t index_i;                   // Ring buffer in index
+    volatile uint32_t index_o;          // Ring buffer out index
+    volatile uint8_t busy;              // Stream transfer active
+    uint32_t transfer;                  // Stream transfer size
+} sample;
+
+
+void SAMPLE_TIMER_IRQHandler(void)
+{
+    TIMER_ClearIntFlag(SAMPLE_TIMER);
+    sample.ticks++;
+}
+
+static void sample_stop(void)
+{
+    TIMER_Stop(SAMPLE_TIMER);
+    TIMER_DisableInt(SAMPLE_TIMER);
+    NVIC_DisableIRQ(SAMPLE_TIMER_IRQn);
+    TIMER_ClearIntFlag(SAMPLE_TIMER);
+    sample.enable = 0;
+}
+
+static void sample_start(uint32_t period)
+{
+    SAMPLE_TIMER->CTL = TIMER_PERIODIC_MODE;
+    SAMPLE_TIMER->CMP = period * (TIMESTAMP_CLOCK / 1000000U);
+    TIMER_ClearIntFlag(SAMPLE_TIMER);
+    TIMER_EnableInt(SAMPLE_TIMER);
+    NVIC_EnableIRQ(SAMPLE_TIMER_IRQn);
+    sample.enable = 1;
+    TIMER_Start(SAMPLE_TIMER);
+}
+
+// Read all configured addresses into one record.
+static void sample_record(void)
+{
+    uint8_t record[SAMPLE_HEADER_SIZE + (SAMPLE_ENTRY_MAX * 4)];
+    uint32_t flags, time, n, i;
+
+    flags = sample.flags;
+
+    if ((sample.ticks - sample.done) > 1) {
+        flags |= SAMPLE_FLAG_OVERRUN;       // Timer periods were skipped
+    }
+
+    sample.done = sample.ticks;
+    time = TIMESTAMP_GET();
+    n = SAMPLE_HEADER_SIZE;
+
+    if (swd_background_begin()) {
+        for (i = 0; i < sample.count; i++) {
+            if (!swd_read_memory(sample.entry_addr[i], &record[n], sample.entry_size[i])) {
+                break;
+            }
+
+            n += sample.entry_size[i];
+        }
+    } else {
+        i = 0;
+    }
+
+    if (i != sample.count) {
+        swd_write_dp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
+        memset(&record[SAMPLE_HEADER_SIZE], 0, sample.size - SAMPLE_HEADER_SIZE);
+        flags |= SAMPLE_FLAG_ERROR;
+    }
+
+    record[0] = (uint8_t)flags;
+    record[1] = (uint8_t)(time >> 0);
+    record[2] = (uint8_t)(time >> 8);
+    record[3] = (uint8_t)(time >> 16);
+    record[4] = (uint8_t)(time >> 24);
+
+    if ((SAMPLE_BUFFER_SIZE - (sample.index_i - sample.index_o)) < sample.size) {
+        sample.flags = SAMPLE_FLAG_OVERRUN; // Host is not keeping up, drop record
+        return;
+    }
+
+    for (n = 0; n < sample.size; n++) {
+        SampleBuf[sample.index_i++ & (SAMPLE_BUFFER_SIZE - 1U)] = record[n];
+    }
+
+    sample.flags = 0;
+}
+
+// Queue contiguous records to the stream endpoint.
+static void sample_stream(void)
+{
+    uint32_t count, index, n;
+
+    if (sample.busy || SWO_StreamActive()) {
+        return;
+    }
+
+    count = sample.index_i - sample.index_o;
+
+    if (count == 0) {
+        return;
+    }
+
+    index = sample.index_o & (SAMPLE_BUFFER_SIZE - 1U);
+    n = SAMPLE_BUFFER_SIZE - index;
+
+    if (count > n) {
+        count = n;
+    }
+
+    sample.transfer = count;
+    sample.busy = 1;
+
+    if (!Sample_QueueTransfer(&SampleBuf[index], count)) {
+        sample.busy = 0;
+    }
+}
+
+// Take due samples and stream records, called from the main loop.
+void SWD_Sample_Process(void)
+{
+    if (!sample.enable) {
+        return;
+    }
+
+    if ((sample.ticks != sample.done) && (DAP_Data.debug_port == DAP_PORT_SWD)) {
+        sample_record();
+    }
+
+    sample_stream();
+}
+
+// Stream transfer complete callback (USB interrupt)
+void SWD_Sample_TransferComplete(void)
+{
+    sample.index_o += sample.transfer;
+    sample.busy = 0;
+}
+
+// SWO trace took over the stream endpoint, record alignment is lost
+void SWD_Sample_Abort(void)
+{
+    sample_stop();
+    sample.busy = 0;
+}
+
+// Process Memory Sample command and prepare response
+//   request:  [0] control: bit0 = enable
+//             [1..2] sample period in us
+//             [3] number of addresses
+//             then per address: [0] access size (1, 2 or 4), [1..4] address
+//   response: status, record size in bytes
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+//   Each configuration flushes the record buffer; the first record streamed
+//   afterwards starts at a record boundary.
+uint32_t SWD_Sample_Config(const uint8_t *request, uint8_t *response)
+{
+    const uint8_t *entry;
+    uint32_t period, count, size, i;
+
+    period = request[1] | (request[2] << 8);
+    count = request[3];
+
+    sample_stop();
+
+    if (sample.busy) {
+        SWO_AbortTransfer();
+        sample.busy = 0;
+    }
+
+    sample.index_o = sample.index_i;
+    sample.flags = 0;
+    sample.count = 0;
+    sample.size = SAMPLE_HEADER_SIZE;
+
+    response[0] = DAP_OK;
+    response[1] = SAMPLE_HEADER_SIZE;
+
+    if ((request[0] & 0x01) == 0) {
+        return ((4U << 16) | 2U);
+    }
+
+    if ((count == 0) || (count > SAMPLE_ENTRY_MAX) || (period < SAMPLE_PERIOD_MIN)) {
+        response[0] = DAP_ERROR;
+        return (((4U + (count * 5U)) << 16) | 2U);
+    }
+
+    entry = &request[4];
+    size = SAMPLE_HEADER_SIZE;
+
+    for (i = 0; i < count; i++, entry += 5) {
+        if ((entry[0] != 1) && (entry[0] != 2) && (entry[0] != 4)) {
+            response[0] = DAP_ERROR;
+            return (((4U + (count * 5U)) << 16) | 2U);
+        }
+
+        sample.entry_size[i] = entry[0];
+        sample.entry_addr[i] = entry[1] | (entry[2] << 8) | (entry[3] << 16) | ((uint32_t)entry[4] << 24);
+        size += entry[0];
+    }
+
+    sample.count = (uint8_t)count;
+    sample.size = (uint8_t)size;
+    response[1] = (uint8_t)size;
+
+    sample.ticks = 0;
+    sample.done = 0;
+    sample_start(period);
+
+    return (((4U + (count * 5U)) << 16) | 2U);
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef __SWD_SAMPLE_H__
+#define __SWD_SAMPLE_H__
+
+#include <stdint.h>
+
+
+// Memory Sample record header flags
+#define SAMPLE_FLAG_ERROR       0x01    // Target read failed, record data is zero
+#define SAMPLE_FLAG_OVERRUN     0x02    // Samples were lost before this record
+
+#define SAMPLE_ENTRY_MAX        8       // Maximum number of sampled addresses
+
+
+void SWD_Sample_Process(void);
+uint32_t SWD_Sample_Config(const uint8_t *request, uint8_t *response);
+void SWD_Sample_TransferComplete(void);
+void SWD_Sample_Abort(void);
+
+
+#endif // __SWD_SAMPLE_H__
@@ -0,0 +1,302 @@
+/**
+ * @file    SWD_standalone.c
+ * @brief   Standalone programming from an image stored in probe flash
+ *
+ * The host stores a descriptor, a flash algorithm blob and a target image
+ * in an APROM area of the probe with ID_DAP_StandaloneWrite. The start
+ * button or ID_DAP_StandaloneRun then programs the image through a
+ * regular SWD_program session: it connects, checks the stored
+ * image CRC, programs, verifies and resets the target into the new image.
+ * The result LED is off while programming, lit on success and blinks on
+ * failure. Programming only starts while no debugger session is connected.
+ */
+#include <string.h>
+
+#include "swd_host.h"
+#include "SWD_flash.h"
+#include "SWD_erase.h"
+#include "SWD_program.h"
+#include "SWD_standalone.h"
+
+#include "DAP_config.h"
+#include "DAP.h"
+
+#if (STANDALONE_ADDR != 0U)
+
+#if (STANDALONE_ADDR < APROM_CODE_SIZE)
+#error "The standalone area must lie above APROM_CODE_SIZE, shrink IROM1 in the project to match!"
+#endif
+#if (((STANDALONE_ADDR | STANDALONE_SIZE) % FMC_FLASH_PAGE_SIZE) != 0U)
+#error "The standalone area must consist of whole flash pages!"
+#endif
+#if ((DAP_JTAG_CACHE_ADDR != 0U) && ((STANDALONE_ADDR + STANDALONE_SIZE) > DAP_JTAG_CACHE_ADDR))
+#error "The standalone area must end below DAP_JTAG_CACHE_ADDR!"
+#endif
+
+#define STANDALONE_WRITE_MAX    ((DAP_PACKET_SIZE - 6U) & ~3U)
+#define STANDALONE_DEBOUNCE     (TIMESTAMP_CLOCK / 50U)     // 20 ms
+#define STANDALONE_BLINK        (TIMESTAMP_CLOCK / 8U)      // 4 Hz
+
+static struct {
+    uint8_t start;                      // Programming requested
+    uint8_t held;                       // Button is down
+    uint8_t pressed;                    // Press already handled
+    uint8_t result;                     // error_t of the last run
+    uint32_t since;                     // Button down or LED toggle time
+    uint32_t next;                      // Address following the last written word
+} standalone;
+
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Check that size bytes at offset lie inside the standalone area.
+static uint8_t standalone_inside(uint32_t offset, uint32_t size)
+{
+    return ((offset <= STANDALONE_SIZE) && (size <= (STANDALONE_SIZE - offset))) ? 1 : 0;
+}
+
+// CRC-32 of the stored image, same as the algorithm crc entry.
+static uint32_t standalone_crc(const uint8_t *data, uint32_t size)
+{
+    CRC_Open(CRC_32, FLASH_CRC_ATTR, 0xFFFFFFFF, CRC_WDATA_8);
+
+    while (size--) {
+        CRC_WRITE_DATA(*data++);
+    }
+
+    return CRC_GetChecksum();
+}
+
+// Compare target flash with the image, on the target if the algorithm has
+// a crc entry, else by reading it back.
+static error_t standalone_verify(const standalone_desc_t *desc, const uint8_t *image)
+{
+    uint8_t buf[32];
+    uint32_t offset, crc, n;
+
+    if (target_flash_algo()->crc != 0) {
+        if ((target_flash_crc(desc->image_addr, desc->image_size, &crc) != ERROR_SUCCESS) ||
+            (crc != desc->image_crc)) {
+            return ERROR_VERIFY;
+        }
+
+        return ERROR_SUCCESS;
+    }
+
+    for (offset = 0; offset < desc->image_size; offset += n) {
+        n = desc->image_size - offset;
+
+        if (n > sizeof(buf)) {
+            n = sizeof(buf);
+        }
+
+        if (!swd_read_memory(desc->image_addr + offset, buf, n) ||
+            (memcmp(buf, &image[offset], n) != 0)) {
+            return ERROR_VERIFY;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+// Program the stored image into the connected target.
+static error_t standalone_program(void)
+{
+    const standalone_desc_t *desc = (const standalone_desc_t *)STANDALONE_ADDR;
+    const uint8_t *image;
+    program_target_t algo;
+    error_t status;
+
+    if ((desc->magic != STANDALONE_MAGIC) ||
+        !standalone_inside(desc->image_offset, desc->image_size) ||
+        !standalone_inside(desc->algo_offset, desc->algo_size)) {
+        return ERROR_FAILURE;
+    }
+
+    image = (const uint8_t *)(STANDALONE_ADDR + desc->image_offset);
+
+    if (standalone_crc(image, desc->image_size) != desc->image_crc) {
+        return ERROR_FAILURE;
+    }
+
+    algo.init = desc->init;
+    algo.uninit = desc->uninit;
+    algo.erase_chip = desc->erase_chip;
+    algo.erase_sector = desc->erase_sector;
+    algo.program_page = desc->program_page;
+    algo.sys_call_s.breakpoint = desc->breakpoint;
+    algo.sys_call_s.static_base = desc->static_base;
+    algo.sys_call_s.stack_pointer = desc->stack_pointer;
+    algo.program_buffer = desc->program_buffer;
+    algo.program_buffer_size = desc->program_buffer_size;
+    algo.program_buffer_2 = desc->program_buffer_2;
+    algo.crc = desc->crc;
+    algo.algo_start = desc->algo_start;
+    algo.algo_size = desc->algo_size;
+    algo.algo_blob = (const uint32_t *)(STANDALONE_ADDR + desc->algo_offset);
+
+    // Connect first, the registry needs the target identity
+    if (!swd_init_debug()) {
+        swd_off();
+        return ERROR_RESET;
+    }
+
+    if (SWD_Program_Begin(&algo, desc->flash_start, desc->sector_size, (uint8_t)desc->control) == ERROR_SUCCESS) {
+        erase_plan_range(desc->image_addr, desc->image_size);
+        SWD_Program_Write(desc->image_addr, image, desc->image_size);
+    }
+
+    status = SWD_Program_Finish();
+
+    if (status == ERROR_SUCCESS) {
+        status = standalone_verify(desc, image);
+    }
+
+    // Start the new image
+    if (status == ERROR_SUCCESS) {
+        swd_set_target_state_hw(NO_DEBUG);
+        swd_set_target_state_hw(RESET_RUN);
+    }
+
+    swd_off();
+
+    return status;
+}
+
+void SWD_Standalone_Init(void)
+{
+    // Quasi-bidirectional high is a weak pull-up for the button
+    GPIO_SetMode(STANDALONE_PORT, (1 << STANDALONE_BUTTON_PIN), GPIO_MODE_QUASI);
+    STANDALONE_BUTTON = 1;
+    GPIO_SetMode(STANDALONE_PORT, (1 << STANDALONE_LED_PIN), GPIO_MODE_OUTPUT);
+    STANDALONE_LED = 0;
+    standalone.result = STANDALONE_NONE;
+}
+
+// Debounce the button, drive the LED and run requested programming,
+// called from the main loop.
+void SWD_Standalone_Process(void)
+{
+    if (STANDALONE_BUTTON == 0) {
+        if (!standalone.held) {
+            standalone.held = 1;
+            standalone.since = TIMESTAMP_GET();
+        } else if (!standalone.pressed && ((TIMESTAMP_GET() - standalone.since) >= STANDALONE_DEBOUNCE)) {
+            standalone.pressed = 1;
+            standalone.start = 1;
+        }
+    } else {
+        standalone.held = 0;
+        standalone.pressed = 0;
+    }
+
+    if (standalone.start) {
+        standalone.start = 0;
+
+        // Never take the port away from a debugger
+        if (DAP_Data.debug_port != DAP_PORT_DISABLED) {
+            return;
+        }
+
+        STANDALONE_LED = 0;
+        standalone.result = standalone_program();
+        STANDALONE_LED = (standalone.result == ERROR_SUCCESS) ? 1 : 0;
+        standalone.since = TIMESTAMP_GET();
+        return;
+    }
+
+    if ((standalone.result != ERROR_SUCCESS) && (standalone.result != STANDALONE_NONE) &&
+        !standalone.held && ((TIMESTAMP_GET() - standalone.since) >= STANDALONE_BLINK)) {
+        standalone.since = TIMESTAMP_GET();
+        STANDALONE_LED ^= 1;
+    }
+}
+
+// Process Standalone Write command and prepare response
+//   Writes the standalone area, erasing each flash page when writing its
+//   first word. Inside a page, writes must continue where the last one
+//   ended; other offsets would write flash that is not erased and are
+//   rejected. A zero length write only reads the result.
+//   request:  [0..3] offset in the standalone area (word aligned)
+//             [4] number of bytes (multiple of 4)
+//             data
+//   response: status, error_t of the last programming run (STANDALONE_NONE = none)
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWD_Standalone_Write(const uint8_t *request, uint8_t *response)
+{
+    uint32_t offset = get_u32(&request[0]);
+    uint32_t count = request[4];
+    uint32_t addr, n;
+    uint8_t ok = 1;
+
+    if (count > STANDALONE_WRITE_MAX) {
+        count = STANDALONE_WRITE_MAX;
+        ok = 0;
+    }
+
+    if (((offset | count) & 3U) || !standalone_inside(offset, count)) {
+        ok = 0;
+    }
+
+    addr = STANDALONE_ADDR + offset;
+
+    if (ok && (count != 0) && ((addr % FMC_FLASH_PAGE_SIZE) != 0) && (addr != standalone.next)) {
+        ok = 0;
+    }
+
+    if (ok && (count != 0)) {
+        SYS_UnlockReg();
+        FMC_Open();
+        FMC_ENABLE_AP_UPDATE();
+
+        for (n = 0; ok && (n < count); n += 4) {
+            addr = STANDALONE_ADDR + offset + n;
+
+            if (((addr % FMC_FLASH_PAGE_SIZE) == 0) && (FMC_Erase(addr) != 0)) {
+                ok = 0;
+            } else if (FMC_Write(addr, get_u32(&request[5 + n])) != 0) {
+                ok = 0;
+            }
+        }
+
+        standalone.next = ok ? (addr + 4) : 0;
+
+        FMC_DISABLE_AP_UPDATE();
+        FMC_Close();
+        SYS_LockReg();
+    }
+
+    response[0] = ok ? DAP_OK : DAP_ERROR;
+    response[1] = standalone.result;
+
+    return (((5U + request[4]) << 16) | 2U);
+}
+
+// Process Standalone Run command and prepare response
+//   Requests programming of the stored image, as the start button does.
+//   The host disconnects first and polls the result with a zero length
+//   Standalone Write, which reads STANDALONE_NONE until the run is done.
+//   request:  none
+//   response: status
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWD_Standalone_Run(const uint8_t *request, uint8_t *response)
+{
+    (void)request;
+
+    if (DAP_Data.debug_port != DAP_PORT_DISABLED) {
+        *response = DAP_ERROR;
+    } else {
+        standalone.result = STANDALONE_NONE;
+        standalone.start = 1;
+        *response = DAP_OK;
+    }
+
+    return ((0U << 16) | 1U);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef __SWD_STANDALONE_H__
+#define __SWD_STANDALONE_H__
+
+#include <stdint.h>
+
+
+#define STANDALONE_MAGIC    0x444E5453U     // "STND"
+#define STANDALONE_NONE     0xFF            // No programming run yet
+
+// Descriptor at the start of the standalone area. The algorithm blob and the
+// image are stored at offsets inside the area.
+typedef struct {
+    uint32_t magic;                     // STANDALONE_MAGIC
+    uint32_t control;                   // PROGRAM_CONTROL_* flags
+    uint32_t flash_start;               // Init() address argument
+    uint32_t sector_size;               // Uniform sector size (0 = no erase)
+    uint32_t image_addr;                // Target address of the image
+    uint32_t image_offset;              // Image offset in the area
+    uint32_t image_size;
+    uint32_t image_crc;                 // CRC-32 of the image
+    uint32_t algo_start;                // Target RAM address of the algorithm blob
+    uint32_t algo_offset;               // Blob offset in the area
+    uint32_t algo_size;
+    uint32_t init;                      // Algorithm entries and buffers, as in program_target_t
+    uint32_t uninit;
+    uint32_t erase_chip;
+    uint32_t erase_sector;
+    uint32_t program_page;
+    uint32_t breakpoint;
+    uint32_t static_base;
+    uint32_t stack_pointer;
+    uint32_t program_buffer;
+    uint32_t program_buffer_size;
+    uint32_t program_buffer_2;
+    uint32_t crc;
+} standalone_desc_t;
+
+
+void SWD_Standalone_Init(void);
+void SWD_Standalone_Process(void);
+uint32_t SWD_Standalone_Write(const uint8_t *request, uint8_t *response);
+uint32_t SWD_Standalone_Run(const uint8_t *request, uint8_t *response);
+
+
+#endif // __SWD_STANDALONE_H__
@@ -0,0 +1,148 @@
+/**
+ * @file    SWD_target.c
+ * @brief   Flash algorithm registry keyed by target identity
+ *
+ * Each registry entry pairs a flash algorithm and sector map with the DP
+ * IDCODE, CPUID and vendor device ID of the devices it programs. The
+ * target is identified when a session asks for the registry and the match
+ * is cached, later lookups only confirm the identity. Flash Start can then
+ * use the matched algorithm instead of one uploaded by the host.
+ */
+#include "swd_host.h"
+#include "SWD_target.h"
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "debug_cm.h"
+
+#define NVIC_Addr           (0xe000e000)
+#define CPUID_MATCH(cpuid)  ((cpuid) & ~(CPUID_VARIANT | CPUID_REVISION))
+
+// NuMicro M031 APROM through the FMC ISP commands, 512 byte pages. Offsets:
+// 0x00 BKPT, 0x04 Init, 0x34 UnInit, 0x46 EraseSector, 0x4E ProgramPage,
+// 0x9E crc. Init unlocks the protected registers and enables ISP with
+// APROM update, UnInit locks them again. There is no chip erase entry.
+static const uint32_t M031_FlashBlob[] = {
+    0xE7FEBE00, 0x20594B2F, 0x20166018, 0x20886018, 0x68186018, 0xD10B2801,
+    0x68184B2B, 0x43082104, 0x4B2A6018, 0x21496818, 0x60184308, 0x47702000,
+    0x47702001, 0x68184B25, 0x43882109, 0x4B216018, 0x60182000, 0x46014770,
+    0x22002022, 0xB570E013, 0x1CCD4604, 0x461608AD, 0x2D002000, 0x6832D00A,
+    0x20214621, 0xF807F000, 0xD1032800, 0x36043404, 0xE7F13D01, 0x4B15BD70,
+    0x605960D8, 0x2001609A, 0xF3BF6118, 0x69188F6F, 0xD1FC07C0, 0x22406818,
+    0xD0024210, 0x20016018, 0x20004770, 0xB5104770, 0x23004A0B, 0x184143DB,
+    0xD0094288, 0x30017804, 0x24084063, 0xD300085B, 0x3C014053, 0xE7F3D1FA,
+    0xBD1043D8, 0x40000100, 0x40000204, 0x4000C000, 0xEDB88320,
+};
+
+// Fits the 2 KB RAM of the smallest parts: algorithm, two page buffers
+// and the stack below 0x20000800.
+static const program_target_t M031_Flash = {
+    0x20000005,                         // Init
+    0x20000035,                         // UnInit
+    0,                                  // EraseChip
+    0x20000047,                         // EraseSector
+    0x2000004F,                         // ProgramPage
+    {
+        0x20000001,                     // BKPT : start of blob + 1
+        0x20000000,                     // RSB  : no static data
+        0x20000800                      // RSP  : top of stack
+    },
+    0x20000100,                         // program_buffer
+    0x20000000,                         // algo_start
+    sizeof(M031_FlashBlob),             // algo_size
+    M031_FlashBlob,                     // algo_blob
+    0x00000200,                         // program_buffer_size
+    0x20000300,                         // program_buffer_2
+    0x2000009F                          // crc
+};
+
+static const sector_info_t M031_Sectors[] = {
+    { 0x00000000, 0x00000200 }
+};
+
+// Chip series in PDID[11:8] of the 512 byte page parts, series G and I
+// use 2 KB pages and are not covered.
+#define M031_PDID_ADDR      (0x40000000)
+#define M031_PDID_SERIES    (0x00000F00)
+#define M031_TARGET(series) \
+    { 0x0BB11477, 0x410CC200, M031_PDID_ADDR, M031_PDID_SERIES, (series) << 8, \
+      0x00000000, &M031_Flash, M031_Sectors, 1 }
+
+// Flash algorithms of the supported targets. Add an entry, its algorithm
+// blob and its sector map for each device family; the list ends with an
+// entry without algorithm.
+static const flash_target_t FlashTargets[] = {
+    M031_TARGET(0xB),
+    M031_TARGET(0xC),
+    M031_TARGET(0xD),
+    M031_TARGET(0xE),
+    { 0 }
+};
+
+static const flash_target_t *flash_target;     // Cached match
+static uint32_t target_idcode;                  // Identity of the cached match
+static uint32_t target_cpuid;
+
+
+// Check an entry's vendor device ID register.
+static uint8_t target_devid_match(const flash_target_t *target)
+{
+    uint32_t devid;
+
+    if (target->devid_addr == 0) {
+        return 1;
+    }
+
+    if (!swd_read_word(target->devid_addr, &devid)) {
+        swd_write_dp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
+        return 0;
+    }
+
+    return ((devid & target->devid_mask) == target->devid) ? 1 : 0;
+}
+
+// Identify the connected target and look up its flash algorithm.
+uint8_t target_flash_identify(void)
+{
+    const flash_target_t *target;
+    uint32_t idcode, cpuid;
+
+    if (FlashTargets[0].algo == 0) {
+        return 0;                       // Empty registry, nothing to match
+    }
+
+    if (!swd_read_dp(DP_IDCODE, &idcode) || !swd_read_word(NVIC_CPUID, &cpuid)) {
+        swd_write_dp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
+        flash_target = 0;
+        return 0;
+    }
+
+    cpuid = CPUID_MATCH(cpuid);
+
+    // The cached match only needs its device ID confirmed
+    if ((flash_target != 0) && (idcode == target_idcode) && (cpuid == target_cpuid) &&
+        target_devid_match(flash_target)) {
+        return 1;
+    }
+
+    flash_target = 0;
+
+    for (target = FlashTargets; target->algo != 0; target++) {
+        if (((target->idcode == 0) || (target->idcode == idcode)) &&
+            ((target->cpuid == 0) || (CPUID_MATCH(target->cpuid) == cpuid)) &&
+            target_devid_match(target)) {
+            flash_target = target;
+            target_idcode = idcode;
+            target_cpuid = cpuid;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Registry entry of the last identified target, 0 if none matched.
+const flash_target_t *target_flash_target(void)
+{
+    return flash_target;
+}
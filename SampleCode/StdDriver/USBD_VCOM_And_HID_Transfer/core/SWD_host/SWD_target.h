@@ -0,0 +1,13 @@
+#ifndef __SWD_TARGET_H__
+#define __SWD_TARGET_H__
+
+#include <stdint.h>
+
+#include "flash_blob.h"
+
+
+uint8_t target_flash_identify(void);
+const flash_target_t *target_flash_target(void);
+
+
+#endif // __SWD_TARGET_H__
@@ -0,0 +1,201 @@
+/**
+ * @file    SWD_watch.c
+ * @brief   Background halt watcher with long-poll event queue
+ *
+ * The watcher polls DHCSR (and optionally DWT comparator MATCHED flags)
+ * between host commands while the target runs. Halt and match events are
+ * queued with a timestamp and collected with the ID_DAP_HaltEvent
+ * long-poll command, which only completes when an event is available or
+ * its timeout expires.
+ */
+#include "swd_host.h"
+#include "SWD_watch.h"
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "debug_cm.h"
+
+#define DBG_Addr        (0xe000edf0)
+
+#define DWT_FUNCTION0   0xE0001028      // DWT_FUNCTIONn = DWT_FUNCTION0 + 16 * n
+#define DWT_MATCHED     0x01000000      // Comparator matched (cleared on read)
+
+#define WATCH_EVENT_CNT 4               // Event queue size (2^n)
+
+typedef struct {
+    uint8_t flags;                      // WATCH_EVENT_*
+    uint8_t dwt;                        // Matched DWT comparators
+    uint32_t dhcsr;                     // DHCSR at detection
+    uint32_t time;                      // Timestamp at detection
+} WATCH_EVENT;
+
+static struct {
+    uint8_t enable;                     // Watcher enabled
+    uint8_t dwt_mask;                   // DWT comparators to watch
+    uint8_t halted;                     // Halt already reported
+    uint8_t waiting;                    // Long-poll in progress
+    uint32_t interval;                  // Poll interval in timer ticks
+    uint32_t last;                      // Time of last poll
+    uint32_t wait_start;                // Long-poll start time
+    uint32_t index_i;                   // Event queue in index
+    uint32_t index_o;                   // Event queue out index
+    WATCH_EVENT event[WATCH_EVENT_CNT];
+} watch;
+
+
+static void watch_queue(uint32_t flags, uint32_t dwt, uint32_t dhcsr)
+{
+    WATCH_EVENT *ev;
+
+    if ((watch.index_i - watch.index_o) == WATCH_EVENT_CNT) {
+        // Queue full: fold into newest event
+        ev = &watch.event[(watch.index_i - 1) & (WATCH_EVENT_CNT - 1)];
+        ev->flags |= (uint8_t)(flags | WATCH_EVENT_OVERFLOW);
+        ev->dwt |= (uint8_t)dwt;
+        return;
+    }
+
+    ev = &watch.event[watch.index_i & (WATCH_EVENT_CNT - 1)];
+    ev->flags = (uint8_t)flags;
+    ev->dwt = (uint8_t)dwt;
+    ev->dhcsr = dhcsr;
+    ev->time = TIMESTAMP_GET();
+    watch.index_i++;
+}
+
+// Poll the target, called from the main loop.
+void SWD_Watch_Process(void)
+{
+    uint32_t dhcsr, val, dwt, n;
+
+    if (!watch.enable || (DAP_Data.debug_port != DAP_PORT_SWD)) {
+        return;
+    }
+
+    if ((TIMESTAMP_GET() - watch.last) < watch.interval) {
+        return;
+    }
+
+    watch.last = TIMESTAMP_GET();
+
+    if (!swd_background_begin()) {
+        return;
+    }
+
+    if (!swd_read_word(DBG_HCSR, &dhcsr)) {
+        swd_write_dp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
+        return;
+    }
+
+    dwt = 0;
+
+    for (n = 0; n < 4; n++) {
+        if (watch.dwt_mask & (1 << n)) {
+            if (!swd_read_word(DWT_FUNCTION0 + (n * 16), &val)) {
+                swd_write_dp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
+                return;
+            }
+
+            if (val & DWT_MATCHED) {
+                dwt |= 1 << n;
+            }
+        }
+    }
+
+    if ((dhcsr & S_HALT) && !watch.halted) {
+        watch_queue(WATCH_EVENT_HALT | (dwt ? WATCH_EVENT_DWT : 0), dwt, dhcsr);
+    } else if (dwt) {
+        watch_queue(WATCH_EVENT_DWT, dwt, dhcsr);
+    }
+
+    watch.halted = (dhcsr & S_HALT) ? 1 : 0;
+}
+
+// Process Halt Watch command and prepare response
+//   request:  [0] flags: bit0 = enable
+//             [1..2] poll interval in ms
+//             [3] DWT comparators to watch (bit n = comparator n)
+//   response: status
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t SWD_Watch_Config(const uint8_t *request, uint8_t *response)
+{
+    uint32_t ms;
+
+    ms = request[1] | (request[2] << 8);
+
+    if (ms == 0) {
+        ms = 1;
+    }
+
+    watch.enable = request[0] & 0x01;
+    watch.dwt_mask = request[3] & 0x0F;
+    watch.interval = ms * (TIMESTAMP_CLOCK / 1000);
+    watch.last = TIMESTAMP_GET() - watch.interval;
+    // A target that is already halted is reported once
+    watch.halted = 0;
+    watch.index_o = watch.index_i;
+
+    *response = DAP_OK;
+    return ((4U << 16) | 1U);
+}
+
+// Process Halt Event long-poll command and prepare response
+//   request:  [0..1] timeout in ms (0 = return immediately,
+//             always 0 inside ID_DAP_ExecuteCommands)
+//   response: number of queued events (including this one),
+//             flags, DWT matched mask, DHCSR (4 bytes), timestamp (4 bytes)
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+//             0 = no event yet, the command is executed again later
+uint32_t SWD_Watch_Event(const uint8_t *request, uint8_t *response)
+{
+    WATCH_EVENT *ev;
+    uint32_t timeout, count;
+
+    timeout = (request[0] | (request[1] << 8)) * (TIMESTAMP_CLOCK / 1000);
+
+    // No long-poll inside ID_DAP_ExecuteCommands
+    if (DAP_Data.nested) {
+        timeout = 0;
+    }
+    count = watch.index_i - watch.index_o;
+
+    if (count == 0) {
+        if (!watch.waiting) {
+            watch.waiting = 1;
+            watch.wait_start = TIMESTAMP_GET();
+        }
+
+        if (((TIMESTAMP_GET() - watch.wait_start) < timeout) && !DAP_TransferAbort) {
+            return 0;
+        }
+    }
+
+    watch.waiting = 0;
+    DAP_TransferAbort = 0;
+
+    response[0] = (uint8_t)count;
+
+    if (count == 0) {
+        response[1] = 0;
+        response[2] = 0;
+        response[3] = response[4] = response[5] = response[6] = 0;
+        response[7] = response[8] = response[9] = response[10] = 0;
+    } else {
+        ev = &watch.event[watch.index_o & (WATCH_EVENT_CNT - 1)];
+        response[1] = ev->flags;
+        response[2] = ev->dwt;
+        response[3] = (uint8_t)(ev->dhcsr >> 0);
+        response[4] = (uint8_t)(ev->dhcsr >> 8);
+        response[5] = (uint8_t)(ev->dhcsr >> 16);
+        response[6] = (uint8_t)(ev->dhcsr >> 24);
+        response[7] = (uint8_t)(ev->time >> 0);
+        response[8] = (uint8_t)(ev->time >> 8);
+        response[9] = (uint8_t)(ev->time >> 16);
+        response[10] = (uint8_t)(ev->time >> 24);
+        watch.index_o++;
+    }
+
+    return ((2U << 16) | 11U);
+}
@@ -0,0 +1,18 @@
+#ifndef __SWD_WATCH_H__
+#define __SWD_WATCH_H__
+
+#include <stdint.h>
+
+
+// Halt Event flags
+#define WATCH_EVENT_HALT        0x01    // Core halted
+#define WATCH_EVENT_DWT         0x02    // DWT comparator matched
+#define WATCH_EVENT_OVERFLOW    0x80    // Events were merged, queue was full
+
+
+void SWD_Watch_Process(void);
+uint32_t SWD_Watch_Config(const uint8_t *request, uint8_t *response);
+uint32_t SWD_Watch_Event(const uint8_t *request, uint8_t *response);
+
+
+#endif // __SWD_WATCH_H__
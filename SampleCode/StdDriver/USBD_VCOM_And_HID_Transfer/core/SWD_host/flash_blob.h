@@ -11,23 +11,39 @@ typedef struct {
 } program_syscall_t;
 
 typedef struct {
-    const uint32_t  init;
-    const uint32_t  uninit;
-    const uint32_t  erase_chip;
-    const uint32_t  erase_sector;
-    const uint32_t  program_page;
-    const program_syscall_t sys_call_s;
-    const uint32_t  program_buffer;
-    const uint32_t  algo_start;
-    const uint32_t  algo_size;
+    uint32_t  init;
+    uint32_t  uninit;
+    uint32_t  erase_chip;
+    uint32_t  erase_sector;
+    uint32_t  program_page;
+    program_syscall_t sys_call_s;
+    uint32_t  program_buffer;
+    uint32_t  algo_start;
+    uint32_t  algo_size;                // 0 = algorithm already in target RAM
     const uint32_t *algo_blob;
-    const uint32_t  program_buffer_size;
+    uint32_t  program_buffer_size;
+    uint32_t  program_buffer_2;         // Second buffer to overlap upload and programming (0 = none)
+    uint32_t  crc;                      // CRC-32 of flash: R0 = crc(addr, size) (0 = none)
 } program_target_t;
 
 typedef struct {
-    const uint32_t start;
-    const uint32_t size;
+    uint32_t start;
+    uint32_t size;
 } sector_info_t;
 
+// Flash algorithm registry entry, matched against the connected target.
+// Zero identity fields match any value.
+typedef struct {
+    uint32_t  idcode;                   // DP IDCODE
+    uint32_t  cpuid;                    // CPUID, variant and revision ignored
+    uint32_t  devid_addr;               // Vendor device ID register (0 = none)
+    uint32_t  devid_mask;
+    uint32_t  devid;
+    uint32_t  flash_start;              // Init() address argument
+    const program_target_t *algo;
+    const sector_info_t *sectors;       // Sector map in ascending order
+    uint32_t  sector_count;
+} flash_target_t;
+
 
 #endif
@@ -66,8 +66,8 @@ uint8_t gu8ConfigDescriptor[] =
 {
     LEN_CONFIG,         /* bLength              */
     DESC_CONFIG,        /* bDescriptorType      */
-    0x6B, 0x00,         /* wTotalLength         */
-    0x03,               /* bNumInterfaces       */
+    0x7B, 0x00,         /* wTotalLength         */
+    0x04,               /* bNumInterfaces       */
     0x01,               /* bConfigurationValue  */
     0x00,               /* iConfiguration       */
     0xC0,               /* bmAttributes         */
@@ -199,6 +199,26 @@ uint8_t gu8ConfigDescriptor[] =
     EP6_MAX_PKT_SIZE & 0x00FF,
     ((EP6_MAX_PKT_SIZE & 0xFF00) >> 8),
     HID_DEFAULT_INT_IN_INTERVAL,        /* bInterval */
+
+    /* SWO streaming trace */
+    /* INTERFACE descriptor */
+    LEN_INTERFACE,                  /* bLength              */
+    DESC_INTERFACE,                 /* bDescriptorType      */
+    0x03,                           /* bInterfaceNumber     */
+    0x00,                           /* bAlternateSetting    */
+    0x01,                           /* bNumEndpoints        */
+    0xFF,                           /* bInterfaceClass      */
+    0x00,                           /* bInterfaceSubClass   */
+    0x00,                           /* bInterfaceProtocol   */
+    0x00,                           /* iInterface           */
+
+    /* ENDPOINT descriptor */
+    LEN_ENDPOINT,                   /* bLength          */
+    DESC_ENDPOINT,                  /* bDescriptorType  */
+    (EP_INPUT | SWO_IN_EP_NUM),     /* bEndpointAddress */
+    EP_BULK,                        /* bmAttributes     */
+    EP7_MAX_PKT_SIZE, 0x00,         /* wMaxPacketSize   */
+    0x00,                           /* bInterval        */
 };
 
 /*!<USB Language String Descriptor */
@@ -250,25 +270,29 @@ uint8_t *gpu8UsbString[4] =
     0,
 };
 
-uint8_t *gu8UsbHidReport[3] =
+uint8_t *gu8UsbHidReport[4] =
 {
     0,
     0,
     HID_DeviceReportDescriptor,
+    0,
 };
 
-uint32_t gu32UsbHidReportLen[3] =
+uint32_t gu32UsbHidReportLen[4] =
 {
     0,
     0,
     sizeof(HID_DeviceReportDescriptor),
+    0,
 };
 
-uint32_t gu32ConfigHidDescIdx[3] =
+/* HID descriptor is followed by its 2 endpoints and the SWO interface (1 endpoint) */
+uint32_t gu32ConfigHidDescIdx[4] =
 {
     0,
     0,
-    (sizeof(gu8ConfigDescriptor) - LEN_HID - (2*LEN_ENDPOINT)),
+    (sizeof(gu8ConfigDescriptor) - LEN_HID - (2*LEN_ENDPOINT) - LEN_INTERFACE - LEN_ENDPOINT),
+    0,
 };
 
 const S_USBD_INFO_T gsInfo =
@@ -18,6 +18,12 @@
 #include <stdio.h>
 #include "NuMicro.h"
 #include "VCOM_and_HID_Transfer.h"
+#include "DAP_config.h"
+#include "DAP.h"
+#include "SWD_watch.h"
+#include "SWD_sample.h"
+#include "SWD_profile.h"
+#include "SWD_standalone.h"
 
 
 extern uint8_t usbd_hid_process(void);
@@ -60,6 +66,9 @@ uint32_t gu32TxSize = 0;
 
 volatile int8_t gi8BulkOutReady = 0;
 
+/* DAP timestamp: TIMER0 24-bit counter wraps */
+volatile uint32_t g_u32TimestampWrap = 0;
+
 void SYS_Init(void)
 {
     /* Unlock protected registers */
@@ -80,6 +89,36 @@ void SYS_Init(void)
     /* Enable UART0 clock */
     CLK_EnableModuleClock(UART0_MODULE);
 
+    /* Switch UART1 (SWO capture) clock source to HIRC */
+    CLK_SetModuleClock(UART1_MODULE, CLK_CLKSEL1_UART1SEL_HIRC, CLK_CLKDIV0_UART1(1));
+
+    /* Enable UART1 and PDMA clock */
+    CLK_EnableModuleClock(UART1_MODULE);
+    CLK_EnableModuleClock(PDMA_MODULE);
+
+    /* Switch SPI0 (JTAG shifter) clock source to PCLK1 and enable it */
+    CLK_SetModuleClock(SPI0_MODULE, CLK_CLKSEL2_SPI0SEL_PCLK1, MODULE_NoMsk);
+    CLK_EnableModuleClock(SPI0_MODULE);
+
+    /* Switch TIMER0 (DAP timestamp) clock source to HIRC and enable it */
+    CLK_SetModuleClock(TMR0_MODULE, CLK_CLKSEL1_TMR0SEL_HIRC, 0);
+    CLK_EnableModuleClock(TMR0_MODULE);
+
+    /* Switch TIMER1 (memory sampler) clock source to HIRC and enable it */
+    CLK_SetModuleClock(TMR1_MODULE, CLK_CLKSEL1_TMR1SEL_HIRC, 0);
+    CLK_EnableModuleClock(TMR1_MODULE);
+
+    /* Switch TIMER2 (PC sampling profiler) clock source to HIRC and enable it */
+    CLK_SetModuleClock(TMR2_MODULE, CLK_CLKSEL1_TMR2SEL_HIRC, 0);
+    CLK_EnableModuleClock(TMR2_MODULE);
+
+    /* Switch TIMER3 (SWO Manchester capture) clock source to HIRC and enable it */
+    CLK_SetModuleClock(TMR3_MODULE, CLK_CLKSEL1_TMR3SEL_HIRC, 0);
+    CLK_EnableModuleClock(TMR3_MODULE);
+
+    /* Enable CRC (incremental flash programming) clock */
+    CLK_EnableModuleClock(CRC_MODULE);
+
     /* Switch USB clock source to HIRC & USB Clock = HIRC / 1 */
     CLK_SetModuleClock(USBD_MODULE, CLK_CLKSEL0_USBDSEL_HIRC, CLK_CLKDIV0_USB(1));
 
@@ -123,6 +162,15 @@ void PowerDown()
     SYS_LockReg();
 }
 
+/*---------------------------------------------------------------------------------------------------------*/
+/* TIMER0 Callback function (DAP timestamp)                                                                */
+/*---------------------------------------------------------------------------------------------------------*/
+void TMR0_IRQHandler(void)
+{
+    TIMER_ClearIntFlag(TIMESTAMP_TIMER);
+    g_u32TimestampWrap++;
+}
+
 /*---------------------------------------------------------------------------------------------------------*/
 /* UART Callback function                                                                                  */
 /*---------------------------------------------------------------------------------------------------------*/
@@ -284,6 +332,13 @@ int32_t main(void)
     /* Init System, peripheral clock and multi-function I/O */
     SYS_Init();
 
+    /* Start DAP timestamp timer: free running at HIRC, interrupt once per 24-bit wrap */
+    TIMESTAMP_TIMER->CTL = TIMER_CONTINUOUS_MODE;
+    TIMESTAMP_TIMER->CMP = TIMER_CMP_MAX_VALUE;
+    TIMER_EnableInt(TIMESTAMP_TIMER);
+    NVIC_EnableIRQ(TMR0_IRQn);
+    TIMER_Start(TIMESTAMP_TIMER);
+
     /* Init UART0 to 115200-8n1 for print message */
     UART_Open(UART0, 115200);
 
@@ -306,6 +361,11 @@ int32_t main(void)
 
     NVIC_EnableIRQ(UART02_IRQn);
 
+#if ((DAP_SWD != 0) && (STANDALONE_ADDR != 0U))
+    /* Standalone programming button and LED */
+    SWD_Standalone_Init();
+#endif
+
 #if CRYSTAL_LESS
     /* Backup default trim */
     u32TrimInit = M32(TRIM_INIT);
@@ -353,6 +413,21 @@ int32_t main(void)
             PowerDown();
 				usbd_hid_process();
         VCOM_TransferData();
+#if ((SWO_UART != 0) || (SWO_MANCHESTER != 0))
+        SWO_Process();
+#endif
+#if (DAP_SWD != 0)
+        SWD_Watch_Process();
+#endif
+#if ((SAMPLE_BUFFER_SIZE != 0U) && (SWO_STREAM != 0))
+        SWD_Sample_Process();
+#endif
+#if (PROFILE_BUCKETS != 0U)
+        SWD_Profile_Process();
+#endif
+#if ((DAP_SWD != 0) && (STANDALONE_ADDR != 0U))
+        SWD_Standalone_Process();
+#endif
     }
 }
 